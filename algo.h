@@ -1,6 +1,102 @@
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <utility>
 
+// Hint to load memory into cache before it is needed.
+#if defined(__GNUC__)
+#define ALGO_PREFETCH(p) __builtin_prefetch(p)
+#else
+#define ALGO_PREFETCH(p)
+#endif
+
+// Vectorized kernels need GCC vector extensions and function clones resolved by the glibc loader.
+#if defined(__GNUC__) && !defined(__clang__) && defined(__x86_64__) && defined(__GLIBC__)
+#define ALGO_SIMD
+#endif
+
+// Counters of ThreadStats and TreeStats are updated only if ALGO_STATS is defined before including algo.h,
+// otherwise the hooks compile to nothing.
+#ifdef ALGO_STATS
+#define ALGO_STAT(counter, n) (algo::GetThreadStats().counter += (n))
+#define ALGO_STAT_DEPTH algo::StatsDepth algo_stats_depth
+#define ALGO_TREE_STAT(counter, n) (stats.counter += (n))
+#else
+#define ALGO_STAT(counter, n) ((void)0)
+#define ALGO_STAT_DEPTH ((void)0)
+#define ALGO_TREE_STAT(counter, n) ((void)0)
+#endif
 
 namespace algo {
+
+    /**
+    * Work done by one thread, counted only with ALGO_STATS. Parallel algorithms count the work
+    * of their worker threads in the workers' stats.
+    *
+    * @param comparisons calls of Less and Greater, also through Reversed and projections. Custom
+    *                    comparators are not counted and vectorized kernels compare without them.
+    * @param swaps element swaps of sorts and selection.
+    * @param moves elements written by merges and by passes of radix and count sorts.
+    * @param allocations buffers allocated by sorts, nodes of containers with NewAllocator and blocks of
+    *                    PoolAllocator and ArenaAllocator.
+    * @param depth current recursion depth of merge and quick sorts.
+    * @param max_depth largest recursion depth since the last reset.
+    */
+    struct ThreadStats {
+        uint64_t comparisons;
+        uint64_t swaps;
+        uint64_t moves;
+        uint64_t allocations;
+        int depth;
+        int max_depth;
+    };
+
+    /**
+    * Returns stats of the calling thread.
+    */
+    inline ThreadStats& GetThreadStats() {
+        static thread_local ThreadStats stats = ThreadStats();
+        return stats;
+    }
+
+    /**
+    * Sets all stats of the calling thread to zero.
+    */
+    inline void ResetThreadStats() { GetThreadStats() = ThreadStats(); }
+
+    /**
+    * Counts one level of recursion while it exists, used by ALGO_STAT_DEPTH.
+    */
+    struct StatsDepth {
+        StatsDepth() {
+            ThreadStats& stats = GetThreadStats();
+            if(++stats.depth > stats.max_depth) stats.max_depth = stats.depth;
+        }
+        ~StatsDepth() { --GetThreadStats().depth; }
+    };
+
+    /**
+    * Rebalancing work of one tree, counted only with ALGO_STATS. Height is computed on request.
+    *
+    * @param rotations single rotations of AVLTree, a double rotation counts as two.
+    * @param splits nodes of ABTree split because of overflow.
+    * @param joins nodes of ABTree that underflowed and took a key from or merged with a brother.
+    * @param height number of levels of nodes.
+    */
+    struct TreeStats {
+        uint64_t rotations;
+        uint64_t splits;
+        uint64_t joins;
+        int height;
+    };
     
     /**
     * Finds larger element from two.
@@ -40,7 +136,7 @@ namespace algo {
     * @return index of larger element.
     */
     template <typename T>
-    inline int MaxIdx(T* arr, int i, int j) { return (arr[i] > arr[j])? i: j; }
+    inline ptrdiff_t MaxIdx(T* arr, ptrdiff_t i, ptrdiff_t j) { return (arr[i] > arr[j])? i: j; }
 
     /**
     * Return index of smaller element from array.
@@ -54,7 +150,98 @@ namespace algo {
     * @return index of smaller element.
     */
     template <typename T>
-    inline int MinIdx(T* arr, int i, int j) { return (arr[i] < arr[j])? i: j; }
+    inline ptrdiff_t MinIdx(T* arr, ptrdiff_t i, ptrdiff_t j) { return (arr[i] < arr[j])? i: j; }
+
+    /**
+    * Default ordering of elements, by operator <.
+    */
+    struct Less {
+        template <typename A, typename B>
+        bool operator()(const A& a, const B& b) const {
+            ALGO_STAT(comparisons, 1);
+            return a < b;
+        }
+    };
+
+    /**
+    * Reversed ordering of elements, by operator > (written as < with swapped arguments).
+    */
+    struct Greater {
+        template <typename A, typename B>
+        bool operator()(const A& a, const B& b) const {
+            ALGO_STAT(comparisons, 1);
+            return b < a;
+        }
+    };
+
+    /**
+    * Reverses given ordering.
+    *
+    * @tparam Compare strict weak ordering, Compare(a, b) is true if a goes before b.
+    */
+    template <typename Compare>
+    struct Reversed {
+        Compare compare;
+        Reversed(Compare c): compare(c) {}
+        template <typename A, typename B>
+        bool operator()(const A& a, const B& b) const { return compare(b, a); }
+    };
+
+    /**
+    * Default projection, elements are compared as they are.
+    */
+    struct Identity {
+        template <typename A>
+        const A& operator()(const A& a) const { return a; }
+    };
+
+    /**
+    * Projection of a record to one of its members, created by Member(&Record::member).
+    */
+    template <typename C, typename M>
+    struct MemberProjection {
+        M C::* member;
+        MemberProjection(M C::* m): member(m) {}
+        const M& operator()(const C& c) const { return c.*member; }
+    };
+
+    template <typename C, typename M>
+    inline MemberProjection<C, M> Member(M C::* member) { return MemberProjection<C, M>(member); }
+
+    /**
+    * Ordering of elements by comparing their projections.
+    */
+    template <typename Compare, typename Projection>
+    struct Projected {
+        Compare compare;
+        Projection projection;
+        Projected(Compare c, Projection p): compare(c), projection(p) {}
+        template <typename A, typename B>
+        bool operator()(const A& a, const B& b) const { return compare(projection(a), projection(b)); }
+    };
+
+    /**
+    * Combines comparator and projection into one ordering of elements.
+    * Without projection the comparator itself is used, so default ordering stays Less.
+    */
+    template <typename Compare>
+    inline Compare MakeOrder(Compare compare, Identity) { return compare; }
+
+    template <typename Compare, typename Projection>
+    inline Projected<Compare, Projection> MakeOrder(Compare compare, Projection projection) {
+        return Projected<Compare, Projection>(compare, projection);
+    }
+
+    /**
+    * Ordering of indexes by the elements of arr they point to.
+    */
+    template <typename T, typename Compare>
+    struct IndexOrder {
+        T* arr;
+        Compare less;
+        IndexOrder(T* a, Compare l): arr(a), less(l) {}
+        bool operator()(ptrdiff_t i, ptrdiff_t j) const { return less(arr[i], arr[j]); }
+    };
 
     /**
     * Return the largest element from array.
@@ -64,20 +251,19 @@ namespace algo {
     * @tparam T must be totally ordered and it must have defined >,<,= operators.
     * @param arr array of elements.
     * @param len length of the first array.
-    * @param min_idx optional, if set, index of the largest element will be assigned to it.
+    * @param max_idx optional, if set, index of the largest element will be assigned to it.
+    * @param compare optional strict weak ordering, compare(a, b) is true if a goes before b.
+    * @param projection optional, elements are compared by projection(element).
     * @return the largest element.
     */
-    template <typename T>
-    T ArrMax(T* arr, int len, int* max_idx = NULL) {
-        T max = arr[0];
-        if(max_idx) *max_idx = 0;
-        for(int i=1; i<len; ++i) {
-            if(arr[i]>max) {
-                max = arr[i];
-                if(max_idx) *max_idx = i;
-            }
+    template <typename T, typename Compare = Less, typename Projection = Identity>
+    T ArrMax(T* arr, ptrdiff_t len, ptrdiff_t* max_idx = NULL, Compare compare = Compare(), Projection projection = Projection()) {
+        ptrdiff_t idx = 0;
+        for(ptrdiff_t i=1; i<len; ++i) {
+            if(compare(projection(arr[idx]), projection(arr[i]))) idx = i;
         }
-        return max;
+        if(max_idx) *max_idx = idx;
+        return arr[idx];
     }
 
     /**
@@ -88,21 +274,559 @@ namespace algo {
     * @tparam T must be totally ordered and it must have defined >,<,= operators.
     * @param arr array of elements.
     * @param len length of the first array.
-    * @param max_idx optional, if set, index of the smallest element will be assigned to it.
+    * @param min_idx optional, if set, index of the smallest element will be assigned to it.
+    * @param compare optional strict weak ordering, compare(a, b) is true if a goes before b.
+    * @param projection optional, elements are compared by projection(element).
     * @return value of the smallest element.
     */
-    template <typename T>
-    T ArrMin(T* arr, int len, int* min_idx = NULL) {
-        T min = arr[0];
-        if(min_idx) *min_idx = 0;
-        for(int i=1; i<len; ++i) {
-            if(arr[i]<min) {
-                min = arr[i];
-                if(min_idx) *min_idx = i;
+    template <typename T, typename Compare = Less, typename Projection = Identity>
+    T ArrMin(T* arr, ptrdiff_t len, ptrdiff_t* min_idx = NULL, Compare compare = Compare(), Projection projection = Projection()) {
+        ptrdiff_t idx = 0;
+        for(ptrdiff_t i=1; i<len; ++i) {
+            if(compare(projection(arr[i]), projection(arr[idx]))) idx = i;
+        }
+        if(min_idx) *min_idx = idx;
+        return arr[idx];
+    }
+
+    /**
+    * Finds the smallest and the largest element of array in one pass.
+    * Elements are taken in pairs, the smaller one is compared only with the minimum and the larger one
+    * only with the maximum, which takes 3 comparisons per 2 elements instead of 4.
+    * For int, float and double in the default ordering the scan is vectorized.
+    * T(n) = O(n).
+    * S(n) = O(1).
+    *
+    * @tparam T must be totally ordered and it must have defined >,<,= operators.
+    * @param arr array of elements.
+    * @param len length of the array, at least 1.
+    * @param min the smallest element will be assigned to it.
+    * @param max the largest element will be assigned to it.
+    * @param min_idx optional, if set, index of the first smallest element will be assigned to it.
+    * @param max_idx optional, if set, index of the first largest element will be assigned to it.
+    * @param compare optional strict weak ordering, compare(a, b) is true if a goes before b.
+    * @param projection optional, elements are compared by projection(element).
+    */
+    template <typename T, typename Compare = Less, typename Projection = Identity>
+    void ArrMinMax(T* arr, ptrdiff_t len, T* min, T* max, ptrdiff_t* min_idx = NULL, ptrdiff_t* max_idx = NULL,
+                   Compare compare = Compare(), Projection projection = Projection()) {
+        ptrdiff_t lo = 0;
+        ptrdiff_t hi = 0;
+        ptrdiff_t i = 1;
+        for(; i+1<len; i+=2) {
+            // equal pair counts as its first element for both, so the first index is kept
+            ptrdiff_t small = i;
+            ptrdiff_t large = i;
+            if(compare(projection(arr[i+1]), projection(arr[i]))) small = i+1;
+            else if(compare(projection(arr[i]), projection(arr[i+1]))) large = i+1;
+            if(compare(projection(arr[small]), projection(arr[lo]))) lo = small;
+            if(compare(projection(arr[hi]), projection(arr[large]))) hi = large;
+        }
+        if(i < len) {
+            if(compare(projection(arr[i]), projection(arr[lo]))) lo = i;
+            if(compare(projection(arr[hi]), projection(arr[i]))) hi = i;
+        }
+        *min = arr[lo];
+        *max = arr[hi];
+        if(min_idx) *min_idx = lo;
+        if(max_idx) *max_idx = hi;
+    }
+
+#ifdef ALGO_SIMD
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpsabi"
+
+    // Vectorized kernels, written with GCC vector extensions and compiled for several instruction sets,
+    // the fastest clone the CPU supports is chosen when the program is loaded.
+    namespace ArrSimd {
+
+        typedef int32_t I32x8 __attribute__((vector_size(32)));
+        typedef float F32x8 __attribute__((vector_size(32)));
+        typedef int64_t I64x4 __attribute__((vector_size(32)));
+        typedef uint64_t U64x4 __attribute__((vector_size(32)));
+
+        typedef int32_t I32x16 __attribute__((vector_size(64)));
+        typedef float F32x16 __attribute__((vector_size(64)));
+        typedef int64_t I64x8 __attribute__((vector_size(64)));
+        typedef double F64x8 __attribute__((vector_size(64)));
+
+        /**
+        * 512-bit vector type V of L lanes for elements of type T, I is the vector of indices of the same shape.
+        * It is one register with AVX-512, two with AVX2 and four with SSE.
+        */
+        template <typename T>
+        struct Wide;
+
+        template <>
+        struct Wide<int32_t> {
+            typedef I32x16 V;
+            typedef I32x16 I;
+            enum { L = 16 };
+        };
+
+        template <>
+        struct Wide<float> {
+            typedef F32x16 V;
+            typedef I32x16 I;
+            enum { L = 16 };
+        };
+
+        template <>
+        struct Wide<double> {
+            typedef F64x8 V;
+            typedef I64x8 I;
+            enum { L = 8 };
+        };
+
+        /**
+        * Finds min and max of array of at least one element in one pass, each lane keeps its own min and max
+        * (and with INDEX their first indices), lanes are reduced at the end. Elements that are not ordered
+        * (NaN) are skipped like by the scalar loop.
+        */
+        template <typename T, bool INDEX>
+        inline __attribute__((always_inline)) void MinMax(const T* arr, int len, T* min, T* max, int* min_idx, int* max_idx) {
+            typedef typename Wide<T>::V V;
+            typedef typename Wide<T>::I I;
+            const int L = Wide<T>::L;
+            V vmin;
+            V vmax;
+            I imin;
+            I imax;
+            I cur;
+            I step;
+            for(int j=0; j<L; ++j) {
+                vmin[j] = arr[0];
+                vmax[j] = arr[0];
+                imin[j] = 0;
+                imax[j] = 0;
+                cur[j] = j;
+                step[j] = L;
+            }
+            int i = 0;
+            for(; i+L<=len; i+=L) {
+                V v;
+                memcpy(&v, arr+i, sizeof(V));
+                if(INDEX) {
+                    I lt = v < vmin;
+                    I gt = vmax < v;
+                    imin = lt? cur: imin;
+                    imax = gt? cur: imax;
+                    cur += step;
+                }
+                vmin = (v < vmin)? v: vmin;
+                vmax = (vmax < v)? v: vmax;
+            }
+            T mn = vmin[0];
+            T mx = vmax[0];
+            int mn_idx = (int)imin[0];
+            int mx_idx = (int)imax[0];
+            for(int j=1; j<L; ++j) {
+                if(vmin[j] < mn || (!(mn < vmin[j]) && imin[j] < mn_idx)) {
+                    mn = vmin[j];
+                    mn_idx = (int)imin[j];
+                }
+                if(mx < vmax[j] || (!(vmax[j] < mx) && imax[j] < mx_idx)) {
+                    mx = vmax[j];
+                    mx_idx = (int)imax[j];
+                }
+            }
+            for(; i<len; ++i) {
+                if(arr[i] < mn) {
+                    mn = arr[i];
+                    mn_idx = i;
+                }
+                if(mx < arr[i]) {
+                    mx = arr[i];
+                    mx_idx = i;
+                }
+            }
+            *min = mn;
+            *max = mx;
+            if(min_idx) *min_idx = mn_idx;
+            if(max_idx) *max_idx = mx_idx;
+        }
+
+        __attribute__((target_clones("avx512f", "avx2", "sse4.2", "default")))
+        inline void MinMaxInt32(const int32_t* arr, int len, int32_t* min, int32_t* max, int* min_idx, int* max_idx) {
+            if(min_idx || max_idx) MinMax<int32_t, true>(arr, len, min, max, min_idx, max_idx);
+            else MinMax<int32_t, false>(arr, len, min, max, NULL, NULL);
+        }
+
+        __attribute__((target_clones("avx512f", "avx2", "sse4.2", "default")))
+        inline void MinMaxFloat(const float* arr, int len, float* min, float* max, int* min_idx, int* max_idx) {
+            if(min_idx || max_idx) MinMax<float, true>(arr, len, min, max, min_idx, max_idx);
+            else MinMax<float, false>(arr, len, min, max, NULL, NULL);
+        }
+
+        __attribute__((target_clones("avx512f", "avx2", "sse4.2", "default")))
+        inline void MinMaxDouble(const double* arr, int len, double* min, double* max, int* min_idx, int* max_idx) {
+            if(min_idx || max_idx) MinMax<double, true>(arr, len, min, max, min_idx, max_idx);
+            else MinMax<double, false>(arr, len, min, max, NULL, NULL);
+        }
+
+        // Kernels keep 32-bit lane indices, longer arrays are scanned in blocks of this length.
+        const ptrdiff_t MINMAX_BLOCK = (ptrdiff_t)1 << 30;
+
+        /**
+        * Runs kernel on blocks of at most MINMAX_BLOCK elements and combines their results, equal elements
+        * of later blocks do not replace the first index. Arrays of one block make a single kernel call.
+        */
+        template <typename T>
+        inline void MinMaxBlocks(void (*kernel)(const T*, int, T*, T*, int*, int*), const T* arr, ptrdiff_t len,
+                                 T* min, T* max, ptrdiff_t* min_idx, ptrdiff_t* max_idx) {
+            int lo = 0;
+            int hi = 0;
+            kernel(arr, (int)Min<ptrdiff_t>(len, MINMAX_BLOCK), min, max, min_idx? &lo: NULL, max_idx? &hi: NULL);
+            ptrdiff_t mn_idx = lo;
+            ptrdiff_t mx_idx = hi;
+            for(ptrdiff_t beg=MINMAX_BLOCK; beg<len; beg+=MINMAX_BLOCK) {
+                T mn, mx;
+                kernel(arr+beg, (int)Min<ptrdiff_t>(len-beg, MINMAX_BLOCK), &mn, &mx, min_idx? &lo: NULL, max_idx? &hi: NULL);
+                if(mn < *min) {
+                    *min = mn;
+                    mn_idx = beg + lo;
+                }
+                if(*max < mx) {
+                    *max = mx;
+                    mx_idx = beg + hi;
+                }
             }
+            if(min_idx) *min_idx = mn_idx;
+            if(max_idx) *max_idx = mx_idx;
         }
+
+    }
+
+    template <>
+    inline void ArrMinMax<int32_t, Less, Identity>(int32_t* arr, ptrdiff_t len, int32_t* min, int32_t* max, ptrdiff_t* min_idx, ptrdiff_t* max_idx, Less, Identity) {
+        ArrSimd::MinMaxBlocks(ArrSimd::MinMaxInt32, arr, len, min, max, min_idx, max_idx);
+    }
+
+    template <>
+    inline void ArrMinMax<float, Less, Identity>(float* arr, ptrdiff_t len, float* min, float* max, ptrdiff_t* min_idx, ptrdiff_t* max_idx, Less, Identity) {
+        ArrSimd::MinMaxBlocks(ArrSimd::MinMaxFloat, arr, len, min, max, min_idx, max_idx);
+    }
+
+    template <>
+    inline void ArrMinMax<double, Less, Identity>(double* arr, ptrdiff_t len, double* min, double* max, ptrdiff_t* min_idx, ptrdiff_t* max_idx, Less, Identity) {
+        ArrSimd::MinMaxBlocks(ArrSimd::MinMaxDouble, arr, len, min, max, min_idx, max_idx);
+    }
+
+    // ArrMax and ArrMin of these types use the vectorized scan too.
+    template <>
+    inline int32_t ArrMax<int32_t, Less, Identity>(int32_t* arr, ptrdiff_t len, ptrdiff_t* max_idx, Less, Identity) {
+        int32_t min, max;
+        ArrSimd::MinMaxBlocks(ArrSimd::MinMaxInt32, arr, len, &min, &max, NULL, max_idx);
+        return max;
+    }
+
+    template <>
+    inline int32_t ArrMin<int32_t, Less, Identity>(int32_t* arr, ptrdiff_t len, ptrdiff_t* min_idx, Less, Identity) {
+        int32_t min, max;
+        ArrSimd::MinMaxBlocks(ArrSimd::MinMaxInt32, arr, len, &min, &max, min_idx, NULL);
         return min;
     }
+
+    template <>
+    inline float ArrMax<float, Less, Identity>(float* arr, ptrdiff_t len, ptrdiff_t* max_idx, Less, Identity) {
+        float min, max;
+        ArrSimd::MinMaxBlocks(ArrSimd::MinMaxFloat, arr, len, &min, &max, NULL, max_idx);
+        return max;
+    }
+
+    template <>
+    inline float ArrMin<float, Less, Identity>(float* arr, ptrdiff_t len, ptrdiff_t* min_idx, Less, Identity) {
+        float min, max;
+        ArrSimd::MinMaxBlocks(ArrSimd::MinMaxFloat, arr, len, &min, &max, min_idx, NULL);
+        return min;
+    }
+
+    template <>
+    inline double ArrMax<double, Less, Identity>(double* arr, ptrdiff_t len, ptrdiff_t* max_idx, Less, Identity) {
+        double min, max;
+        ArrSimd::MinMaxBlocks(ArrSimd::MinMaxDouble, arr, len, &min, &max, NULL, max_idx);
+        return max;
+    }
+
+    template <>
+    inline double ArrMin<double, Less, Identity>(double* arr, ptrdiff_t len, ptrdiff_t* min_idx, Less, Identity) {
+        double min, max;
+        ArrSimd::MinMaxBlocks(ArrSimd::MinMaxDouble, arr, len, &min, &max, min_idx, NULL);
+        return min;
+    }
+
+#pragma GCC diagnostic pop
+#endif
+
+    // Operations used by parallel reductions.
+    namespace ArrParallel {
+
+        // Arrays are reduced in chunks of this length, partial results are combined in chunk order,
+        // so the result does not depend on the number of threads.
+        const int CHUNK_LEN = 1 << 16;
+
+        /**
+        * Computes partial results of chunks first, ..., last-1.
+        */
+        template <typename T, typename R, typename Chunk>
+        void ReduceChunks(T* arr, ptrdiff_t len, ptrdiff_t first, ptrdiff_t last, R* partials, Chunk chunk) {
+            for(ptrdiff_t c=first; c<last; ++c) {
+                ptrdiff_t beg = c * CHUNK_LEN;
+                partials[c] = chunk(arr, beg, beg + Min<ptrdiff_t>(CHUNK_LEN, len - beg));
+            }
+        }
+
+        /**
+        * Reduces array of at least one element, chunk(arr, beg, end) gives partial result of [beg, end),
+        * combine(a, b) joins partial results of neighbouring parts. Contiguous runs of chunks are given
+        * to the threads, arrays of one chunk are reduced by the calling thread.
+        * T(n) = O(n / p + n / CHUNK_LEN), where p is the number of threads.
+        * S(n) = O(n / CHUNK_LEN).
+        */
+        template <typename T, typename R, typename Chunk, typename Combine>
+        R Reduce(T* arr, ptrdiff_t len, Chunk chunk, Combine combine, int threads) {
+            ptrdiff_t chunks = (len - 1) / CHUNK_LEN + 1;
+            if(chunks == 1) return chunk(arr, 0, len);
+            if(threads <= 0) threads = (int)std::thread::hardware_concurrency();
+            threads = (int)Max<ptrdiff_t>(1, Min<ptrdiff_t>(threads, chunks));
+            R* partials = new R[chunks];
+            std::thread* workers = new std::thread[threads];
+            for(int t=1; t<threads; ++t) {
+                ptrdiff_t first = chunks * t / threads;
+                ptrdiff_t last = chunks * (t+1) / threads;
+                workers[t] = std::thread(ReduceChunks<T, R, Chunk>, arr, len, first, last, partials, chunk);
+            }
+            ReduceChunks<T, R, Chunk>(arr, len, 0, chunks / threads, partials, chunk);
+            for(int t=1; t<threads; ++t) workers[t].join();
+            R result = partials[0];
+            for(ptrdiff_t c=1; c<chunks; ++c) result = combine(result, partials[c]);
+            delete[] workers;
+            delete[] partials;
+            return result;
+        }
+
+        /**
+        * Folds chunk by op from its first element.
+        */
+        template <typename Op>
+        struct Fold {
+            Op op;
+            Fold(Op o): op(o) {}
+            template <typename T>
+            T operator()(T* arr, ptrdiff_t beg, ptrdiff_t end) const {
+                T acc = arr[beg];
+                for(ptrdiff_t i=beg+1; i<end; ++i) acc = op(acc, arr[i]);
+                return acc;
+            }
+        };
+
+        // Number of independent accumulators of Sum, they hide the latency of floating point addition.
+        const int SUM_LANES = 8;
+
+        /**
+        * Sums chunk into accumulator of type R, element i is added to accumulator i % SUM_LANES.
+        */
+        template <typename R>
+        struct Sum {
+            template <typename T>
+            R operator()(T* arr, ptrdiff_t beg, ptrdiff_t end) const {
+                R acc[SUM_LANES];
+                for(int j=0; j<SUM_LANES; ++j) acc[j] = R();
+                ptrdiff_t i = beg;
+                for(; i+SUM_LANES<=end; i+=SUM_LANES) {
+                    for(int j=0; j<SUM_LANES; ++j) acc[j] += arr[i+j];
+                }
+                for(int j=0; i<end; ++i, ++j) acc[j] += arr[i];
+                for(int j=1; j<SUM_LANES; ++j) acc[0] += acc[j];
+                return acc[0];
+            }
+        };
+
+        template <typename R>
+        struct Plus {
+            R operator()(const R& a, const R& b) const { return a + b; }
+        };
+
+        /**
+        * Counts elements of chunk the predicate is true for.
+        */
+        template <typename Predicate>
+        struct Count {
+            Predicate pred;
+            Count(Predicate p): pred(p) {}
+            template <typename T>
+            ptrdiff_t operator()(T* arr, ptrdiff_t beg, ptrdiff_t end) const {
+                ptrdiff_t count = 0;
+                for(ptrdiff_t i=beg; i<end; ++i) count += pred(arr[i])? 1: 0;
+                return count;
+            }
+        };
+
+        /**
+        * Predicate of elements equal to value.
+        */
+        template <typename T>
+        struct Equal {
+            T value;
+            Equal(const T& v): value(v) {}
+            bool operator()(const T& x) const { return x == value; }
+        };
+
+        /**
+        * Index of the first largest (or smallest if MIN) element of chunk, by ArrMax/ArrMin.
+        */
+        template <bool MIN, typename Compare, typename Projection>
+        struct Extreme {
+            Compare compare;
+            Projection projection;
+            Extreme(Compare c, Projection p): compare(c), projection(p) {}
+            template <typename T>
+            ptrdiff_t operator()(T* arr, ptrdiff_t beg, ptrdiff_t end) const {
+                ptrdiff_t idx;
+                if(MIN) ArrMin<T, Compare, Projection>(arr+beg, end-beg, &idx, compare, projection);
+                else ArrMax<T, Compare, Projection>(arr+beg, end-beg, &idx, compare, projection);
+                return beg + idx;
+            }
+        };
+
+        /**
+        * Chooses index of the larger (or smaller if MIN) element, the left one if they are equal.
+        */
+        template <typename T, bool MIN, typename Compare, typename Projection>
+        struct ExtremeCombine {
+            T* arr;
+            Compare compare;
+            Projection projection;
+            ExtremeCombine(T* a, Compare c, Projection p): arr(a), compare(c), projection(p) {}
+            ptrdiff_t operator()(ptrdiff_t a, ptrdiff_t b) const {
+                if(MIN) return compare(projection(arr[b]), projection(arr[a]))? b: a;
+                return compare(projection(arr[a]), projection(arr[b]))? b: a;
+            }
+        };
+
+    }
+
+    /**
+    * Reduces array by associative operation, result is init op arr[0] op arr[1] op ... op arr[len-1].
+    * The array is split into chunks of ArrParallel::CHUNK_LEN elements reduced by worker threads, partial
+    * results are combined in order, so op does not have to be commutative and the result (also of
+    * floating point operations) does not depend on the number of threads. Short arrays are reduced
+    * by the calling thread.
+    * T(n) = O(n / p), where p is the number of threads.
+    * S(n) = O(n / CHUNK_LEN).
+    *
+    * @tparam T type of elements.
+    * @tparam Op associative operation, T op(const T& a, const T& b).
+    * @param arr array of elements.
+    * @param len length of the array.
+    * @param init initial value, result for empty array.
+    * @param op associative operation.
+    * @param threads number of threads, 0 for the number of hardware threads.
+    * @return reduced value.
+    */
+    template <typename T, typename Op>
+    T ArrReduce(T* arr, ptrdiff_t len, T init, Op op, int threads = 0) {
+        if(len < 1) return init;
+        return op(init, ArrParallel::Reduce<T, T>(arr, len, ArrParallel::Fold<Op>(op), op, threads));
+    }
+
+    /**
+    * Sums array in parallel, see ArrReduce. Each chunk is summed into several accumulators.
+    * T(n) = O(n / p), where p is the number of threads.
+    * S(n) = O(n / CHUNK_LEN).
+    *
+    * @tparam T type of elements, must be addable to R.
+    * @tparam R type of the sum, T by default, a wider type avoids overflow.
+    * @param arr array of elements.
+    * @param len length of the array.
+    * @param threads number of threads, 0 for the number of hardware threads.
+    * @return sum of the elements, R() for empty array.
+    */
+    template <typename T, typename R = T>
+    R ArrSum(T* arr, ptrdiff_t len, int threads = 0) {
+        if(len < 1) return R();
+        return ArrParallel::Reduce<T, R>(arr, len, ArrParallel::Sum<R>(), ArrParallel::Plus<R>(), threads);
+    }
+
+    /**
+    * Counts elements the predicate is true for, in parallel, see ArrReduce.
+    * T(n) = O(n / p), where p is the number of threads.
+    * S(n) = O(n / CHUNK_LEN).
+    *
+    * @param arr array of elements.
+    * @param len length of the array.
+    * @param pred predicate, bool pred(const T& x).
+    * @param threads number of threads, 0 for the number of hardware threads.
+    * @return number of elements pred is true for.
+    */
+    template <typename T, typename Predicate>
+    ptrdiff_t ArrCountIf(T* arr, ptrdiff_t len, Predicate pred, int threads = 0) {
+        if(len < 1) return 0;
+        return ArrParallel::Reduce<T, ptrdiff_t>(arr, len, ArrParallel::Count<Predicate>(pred), ArrParallel::Plus<ptrdiff_t>(), threads);
+    }
+
+    /**
+    * Counts elements equal to value, in parallel, see ArrReduce.
+    * T(n) = O(n / p), where p is the number of threads.
+    * S(n) = O(n / CHUNK_LEN).
+    *
+    * @tparam T must have defined = operator.
+    * @param arr array of elements.
+    * @param len length of the array.
+    * @param value counted value.
+    * @param threads number of threads, 0 for the number of hardware threads.
+    * @return number of elements equal to value.
+    */
+    template <typename T>
+    ptrdiff_t ArrCount(T* arr, ptrdiff_t len, const T& value, int threads = 0) {
+        return ArrCountIf<T>(arr, len, ArrParallel::Equal<T>(value), threads);
+    }
+
+    /**
+    * Return the largest element from array, chunks are scanned by ArrMax in parallel, see ArrReduce.
+    * T(n) = O(n / p), where p is the number of threads.
+    * S(n) = O(n / CHUNK_LEN).
+    *
+    * @tparam T must be totally ordered and it must have defined >,<,= operators.
+    * @param arr array of elements.
+    * @param len length of the array, at least 1.
+    * @param max_idx optional, if set, index of the first largest element will be assigned to it.
+    * @param threads number of threads, 0 for the number of hardware threads.
+    * @param compare optional strict weak ordering, compare(a, b) is true if a goes before b.
+    * @param projection optional, elements are compared by projection(element).
+    * @return the largest element.
+    */
+    template <typename T, typename Compare = Less, typename Projection = Identity>
+    T ArrParallelMax(T* arr, ptrdiff_t len, ptrdiff_t* max_idx = NULL, int threads = 0,
+                     Compare compare = Compare(), Projection projection = Projection()) {
+        ptrdiff_t idx = ArrParallel::Reduce<T, ptrdiff_t>(arr, len, ArrParallel::Extreme<false, Compare, Projection>(compare, projection),
+                                                    ArrParallel::ExtremeCombine<T, false, Compare, Projection>(arr, compare, projection), threads);
+        if(max_idx) *max_idx = idx;
+        return arr[idx];
+    }
+
+    /**
+    * Return the smallest element from array, chunks are scanned by ArrMin in parallel, see ArrReduce.
+    * T(n) = O(n / p), where p is the number of threads.
+    * S(n) = O(n / CHUNK_LEN).
+    *
+    * @tparam T must be totally ordered and it must have defined >,<,= operators.
+    * @param arr array of elements.
+    * @param len length of the array, at least 1.
+    * @param min_idx optional, if set, index of the first smallest element will be assigned to it.
+    * @param threads number of threads, 0 for the number of hardware threads.
+    * @param compare optional strict weak ordering, compare(a, b) is true if a goes before b.
+    * @param projection optional, elements are compared by projection(element).
+    * @return the smallest element.
+    */
+    template <typename T, typename Compare = Less, typename Projection = Identity>
+    T ArrParallelMin(T* arr, ptrdiff_t len, ptrdiff_t* min_idx = NULL, int threads = 0,
+                     Compare compare = Compare(), Projection projection = Projection()) {
+        ptrdiff_t idx = ArrParallel::Reduce<T, ptrdiff_t>(arr, len, ArrParallel::Extreme<true, Compare, Projection>(compare, projection),
+                                                    ArrParallel::ExtremeCombine<T, true, Compare, Projection>(arr, compare, projection), threads);
+        if(min_idx) *min_idx = idx;
+        return arr[idx];
+    }
     
     /**
     * Swaps two elements in array.
@@ -115,10 +839,11 @@ namespace algo {
     * @param j index of second element.
     */
     template <typename T>
-    void ArrSwap(T* arr, int i, int j) {
-        T temp = arr[i];
-        arr[i] = arr[j];
-        arr[j] = temp;
+    void ArrSwap(T* arr, ptrdiff_t i, ptrdiff_t j) {
+        ALGO_STAT(swaps, 1);
+        T temp = std::move(arr[i]);
+        arr[i] = std::move(arr[j]);
+        arr[j] = std::move(temp);
     }
     
     // Operation on binary heap stored in array.
@@ -136,9 +861,9 @@ namespace algo {
         * @param is_max Is the heap maximal?
         */
         template <typename T>
-        void Insert(T* arr, int heap_len, bool is_max) {
-            int last = heap_len;
-	    int next = (last-1)/2;
+        void Insert(T* arr, ptrdiff_t heap_len, bool is_max) {
+            ptrdiff_t last = heap_len;
+	    ptrdiff_t next = (last-1)/2;
 	    while(is_max? (arr[next] < arr[last]): (arr[next] > arr[last])) {
 		ArrSwap<T>(arr, next, last);
 		last = next;
@@ -157,468 +882,4736 @@ namespace algo {
         * @param is_max Is the heap maximal?
         */
         template <typename T>
-        void Remove(T* arr, int heap_len, bool is_max) {
+        void Remove(T* arr, ptrdiff_t heap_len, bool is_max) {
             ArrSwap<T>(arr, 0, heap_len);
-            int last = 0;
-            int next = 2*last+1;
+            ptrdiff_t last = 0;
+            ptrdiff_t next = 2*last+1;
             if(next > heap_len-1) return; 
-            if(is_max) next = MaxIdx<T>(arr, next, Min<int>(next+1, heap_len-1));
-            else next = MinIdx<T>(arr, next, Min<int>(next+1, heap_len-1));
+            if(is_max) next = MaxIdx<T>(arr, next, Min<ptrdiff_t>(next+1, heap_len-1));
+            else next = MinIdx<T>(arr, next, Min<ptrdiff_t>(next+1, heap_len-1));
 
 	    while(is_max ? (arr[next]>arr[last]) : (arr[next]<arr[last]) ) {
 		ArrSwap<T>(arr, last, next);
 		last = next;
                 next = 2*next+1;
                 if(next > heap_len-1) return; 
-                if(is_max) next = MaxIdx<T>(arr, next, Min<int>(next+1, heap_len-1));
-                else next = MinIdx<T>(arr, next, Min<int>(next+1, heap_len-1));
+                if(is_max) next = MaxIdx<T>(arr, next, Min<ptrdiff_t>(next+1, heap_len-1));
+                else next = MinIdx<T>(arr, next, Min<ptrdiff_t>(next+1, heap_len-1));
 	    }
         }
 
-    }
-    
-    /**
-    * Sorts array using heap-sort algorithm.
-    * T(n) = O(n log(n)), where n is arr size.
-    * S(n) = O(1).
-    *
-    * @tparam T must be totally ordered and it must have defined >,<,= operators.
-    * @param arr array of elements.
-    * @param len length of the array.
-    * @param rising Sort the array in rising order?.
-    */
-    template <typename T>
-    void ArrHeapSort(T* arr, int len, bool rising = true) {
-        for(int i=1; i<len; ++i) ArrHeap::Insert<T>(arr, i, rising);
-        for(int i=len-1; i>0; --i) ArrHeap::Remove<T>(arr, i, rising);
-    }
+        /**
+        * Moves element at index i of d-ary heap in array down to its place.
+        * The heap is maximal in the given ordering, for Greater it is minimal.
+        * Children of node k are D*k+1, ..., D*k+D, so for D = 4 or 8 they share one cache line.
+        * The hole is first moved along the larger children down to a leaf and the element is then sifted up
+        * from there, which saves one comparison per level as elements mostly belong near the leaves.
+        * T(n) = O(D log(n) / log(D)).
+        * S(n) = O(1).
+        *
+        * @tparam T must be totally ordered by Compare.
+        * @tparam D arity of the heap.
+        * @tparam Compare strict weak ordering, resolved at compile time.
+        * @param arr array of elements.
+        * @param heap_len length of the heap.
+        * @param i index of the element.
+        * @param less ordering, less(a, b) is true if a belongs below b.
+        */
+        template <typename T, int D, typename Compare>
+        void SiftDown(T* arr, ptrdiff_t heap_len, ptrdiff_t i, Compare less) {
+            T temp = std::move(arr[i]);
+            ptrdiff_t hole = i;
+            while(true) {
+                ptrdiff_t first = D*hole + 1;
+                if(first >= heap_len) break;
+                ptrdiff_t best = first;
+                // grandchildren are loaded next, for D = 4 they are one cache line
+                if(D*first + 1 < heap_len) ALGO_PREFETCH(arr + D*first + 1);
+                // children are chosen without branching, the result is unpredictable
+                if(first + D <= heap_len) {
+                    for(ptrdiff_t c=first+1; c<first+D; ++c) best += less(arr[best], arr[c]) * (c - best);
+                }
+                else {
+                    for(ptrdiff_t c=first+1; c<heap_len; ++c) best += less(arr[best], arr[c]) * (c - best);
+                }
+                arr[hole] = std::move(arr[best]);
+                hole = best;
+            }
+            while(hole > i) {
+                ptrdiff_t parent = (hole-1)/D;
+                if(!less(arr[parent], temp)) break;
+                arr[hole] = std::move(arr[parent]);
+                hole = parent;
+            }
+            arr[hole] = std::move(temp);
+        }
 
-    
-    /**
-    * Sorts array using merge-sort algorithm.
-    * T(n) = O(n log(n)).
-    * S(n) = O(n log(n)), where n is arr size.
+        /**
+        * Makes d-ary heap from array bottom-up (Floyd's method).
+        * T(n) = O(n).
+        * S(n) = O(1).
+        *
+        * @tparam T must be totally ordered by Compare.
+        * @tparam D arity of the heap.
+        * @tparam Compare strict weak ordering, resolved at compile time.
+        * @param arr array of elements.
+        * @param len length of the array.
+        * @param less ordering, the largest element will be on top.
+        */
+        template <typename T, int D, typename Compare>
+        void Build(T* arr, ptrdiff_t len, Compare less) {
+            for(ptrdiff_t i=(len-2)/D; i>=0; --i) SiftDown<T, D, Compare>(arr, len, i, less);
+        }
+
+        /**
+        * Moves element at index i of d-ary heap in array up to its place.
+        * T(n) = O(log(n) / log(D)).
+        * S(n) = O(1).
+        *
+        * @param less ordering, the largest element is on top.
+        */
+        template <typename T, int D, typename Compare>
+        void SiftUp(T* arr, ptrdiff_t i, Compare less) {
+            T temp = std::move(arr[i]);
+            while(i > 0) {
+                ptrdiff_t parent = (i-1)/D;
+                if(!less(arr[parent], temp)) break;
+                arr[i] = std::move(arr[parent]);
+                i = parent;
+            }
+            arr[i] = std::move(temp);
+        }
+
+        /**
+        * Sorts d-ary heap in array by repeatedly moving its top to the end, in rising order of less.
+        * T(n) = O(n log(n)).
+        * S(n) = O(1).
+        */
+        template <typename T, int D, typename Compare>
+        void SortHeap(T* arr, ptrdiff_t len, Compare less) {
+            for(ptrdiff_t i=len-1; i>0; --i) {
+                ArrSwap<T>(arr, 0, i);
+                SiftDown<T, D, Compare>(arr, i, 0, less);
+            }
+        }
+
+        /**
+        * Sorts array by d-ary heap, in rising order of less.
+        * T(n) = O(n log(n)).
+        * S(n) = O(1).
+        */
+        template <typename T, int D, typename Compare>
+        void Sort(T* arr, ptrdiff_t len, Compare less) {
+            if(len < 2) return;
+            Build<T, D, Compare>(arr, len, less);
+            SortHeap<T, D, Compare>(arr, len, less);
+        }
+
+    }
+    
+    /**
+    * Sorts array using heap-sort algorithm.
+    * Heap is d-ary, built bottom-up in O(n), the ordering is resolved at compile time.
+    * T(n) = O(n log(n)), where n is arr size.
+    * S(n) = O(1).
     *
     * @tparam T must be totally ordered and it must have defined >,<,= operators.
+    * @tparam Arity arity of the heap, 4 or 8 keep children of a node in one cache line.
     * @param arr array of elements.
     * @param len length of the array.
+    * @param rising Sort the array in rising order?.
+    * @param compare optional strict weak ordering, compare(a, b) is true if a goes before b.
+    * @param projection optional, elements are compared by projection(element).
     */
-    template <typename T>
-    void ArrMergeSort(T* arr, int len) {
-        if(len > 1) {
-            int half = len/2;
-            T* a = new T[half];
-            T* b = new T[len-half];
-            for(int i=0; i<len; ++i) {
-                if(i<half) a[i] = arr[i];
-                else b[i-half] = arr[i];
-            }
-            ArrMergeSort<int>(a, half);
-            ArrMergeSort<int>(b, len-half);
-            int a_idx = 0;
-            int b_idx = 0;
-            for(int i=0; i<len; ++i) {
-                if(a_idx == half) arr[i] = b[b_idx++];
-                else if(b_idx == len-half) arr[i] = a[a_idx++];
-                else {
-                    if(a[a_idx] < b[b_idx]) arr[i] = a[a_idx++];
-                    else arr[i] = b[b_idx++];
+    template <typename T, int Arity = 4, typename Compare = Less, typename Projection = Identity>
+    void ArrHeapSort(T* arr, ptrdiff_t len, bool rising = true, Compare compare = Compare(), Projection projection = Projection()) {
+        if(rising) ArrHeap::Sort<T, Arity>(arr, len, MakeOrder(compare, projection));
+        else ArrHeap::Sort<T, Arity>(arr, len, MakeOrder(Reversed<Compare>(compare), projection));
+    }
+
+    
+    // Insertion sort used by other sorts for short parts.
+    namespace ArrInsertion {
+
+        /**
+        * Sorts array by insertion sort in rising order of less.
+        * T(n) = O(n^2), O(n + k) where k is the number of inversions.
+        * S(n) = O(1).
+        */
+        template <typename T, typename Compare>
+        void Sort(T* arr, ptrdiff_t len, Compare less) {
+            for(ptrdiff_t i=1; i<len; ++i) {
+                T temp = std::move(arr[i]);
+                ptrdiff_t j = i;
+                while(j > 0 && less(temp, arr[j-1])) {
+                    arr[j] = std::move(arr[j-1]);
+                    --j;
                 }
+                arr[j] = std::move(temp);
             }
-            delete[] a;
-            delete[] b;
         }
+
     }
-    
-    
+
     /**
-    * Sorts array using count-sort algorithm.
-    * T(n) = O(n + m).
-    * S(n) = O(m), where n is arr size and m = Max(arr) - Min(arr)
+    * Sorts array using insertion-sort algorithm.
+    * Fast for short or almost sorted arrays.
+    * T(n) = O(n^2), O(n + k) where k is the number of inversions.
+    * S(n) = O(1).
     *
     * @tparam T must be totally ordered and it must have defined >,<,= operators.
     * @param arr array of elements.
     * @param len length of the array.
+    * @param compare optional strict weak ordering, compare(a, b) is true if a goes before b.
+    * @param projection optional, elements are compared by projection(element).
     */
-    void CountSort(int* arr, int len) {
-        int min = ArrMin<int>(arr, len);
-        int max = ArrMax<int>(arr, len);
-        int t_len = max - min + 1;
-        int* t_arr = new int[t_len];
-        for(int i=0; i<t_len; ++i) t_arr[i] = 0;
-        for(int i=0; i<len; ++i) ++t_arr[arr[i]-min];
-        int idx = 0;
-        for(int i=0; i<len; ++i) {
-            while(t_arr[idx] == 0) ++idx;
-            arr[i]=idx+min;
-            --t_arr[idx];
+    template <typename T, typename Compare = Less, typename Projection = Identity>
+    void ArrInsertionSort(T* arr, ptrdiff_t len, Compare compare = Compare(), Projection projection = Projection()) {
+        ArrInsertion::Sort<T>(arr, len, MakeOrder(compare, projection));
+    }
+
+    // Operations used by merge sorts.
+    namespace ArrMerge {
+
+        // Parts of at most this length are sorted by insertion sort.
+        const int INSERTION_SORT_CUTOFF = 16;
+
+        /**
+        * Merges two sorted arrays into dst. Equal elements are taken from the first array first.
+        * T(n) = O(n), where n = a_len + b_len.
+        * S(n) = O(1).
+        *
+        * @tparam T must be totally ordered by Compare.
+        * @param a first sorted array.
+        * @param a_len length of the first array.
+        * @param b second sorted array.
+        * @param b_len length of the second array.
+        * @param dst array of length a_len + b_len, must not overlap with a or b.
+        * @param less strict weak ordering the arrays are sorted by.
+        */
+        template <typename T, typename Compare>
+        void Merge(T* a, ptrdiff_t a_len, T* b, ptrdiff_t b_len, T* dst, Compare less) {
+            ALGO_STAT(moves, a_len + b_len);
+            ptrdiff_t i = 0;
+            ptrdiff_t j = 0;
+            while(i < a_len && j < b_len) {
+                if(less(b[j], a[i])) *dst++ = std::move(b[j++]);
+                else *dst++ = std::move(a[i++]);
+            }
+            while(i < a_len) *dst++ = std::move(a[i++]);
+            while(j < b_len) *dst++ = std::move(b[j++]);
+        }
+
+        /**
+        * Finds the co-rank of k: number of elements of a among the first k elements of merged a and b.
+        * The split agrees with Merge, so the two parts can be merged independently.
+        * T(n) = O(log(n)).
+        * S(n) = O(1).
+        *
+        * @tparam T must be totally ordered by Compare.
+        * @param k position in the merged array, 0 <= k <= a_len + b_len.
+        * @param a first sorted array.
+        * @param a_len length of the first array.
+        * @param b second sorted array.
+        * @param b_len length of the second array.
+        * @param less strict weak ordering the arrays are sorted by.
+        * @return number of elements taken from a.
+        */
+        template <typename T, typename Compare>
+        ptrdiff_t CoRank(ptrdiff_t k, T* a, ptrdiff_t a_len, T* b, ptrdiff_t b_len, Compare less) {
+            ptrdiff_t lo = Max<ptrdiff_t>(0, k - b_len);
+            ptrdiff_t hi = Min<ptrdiff_t>(k, a_len);
+            while(lo < hi) {
+                ptrdiff_t i = lo + (hi-lo)/2;
+                ptrdiff_t j = k - i;
+                if(j > 0 && !less(b[j-1], a[i])) lo = i+1;
+                else hi = i;
+            }
+            return lo;
+        }
+
+        /**
+        * Sorts src, dst of the same length is used as scratch space.
+        * Halves are sorted into the other array than the result, so every level merges without copying.
+        * Parts of at most INSERTION_SORT_CUTOFF elements are sorted by insertion sort.
+        * T(n) = O(n log(n)).
+        * S(n) = O(log(n)) for recursion.
+        *
+        * @tparam T must be totally ordered by Compare.
+        * @param src array of elements.
+        * @param dst scratch array of length len, must not overlap with src.
+        * @param len length of the arrays.
+        * @param to_dst if true, the sorted result is stored in dst, otherwise in src.
+        * @param less strict weak ordering to sort by.
+        */
+        template <typename T, typename Compare>
+        void SortScalar(T* src, T* dst, ptrdiff_t len, bool to_dst, Compare less) {
+            ALGO_STAT_DEPTH;
+            if(len <= INSERTION_SORT_CUTOFF) {
+                if(to_dst) {
+                    for(ptrdiff_t i=0; i<len; ++i) dst[i] = std::move(src[i]);
+                    ArrInsertion::Sort<T>(dst, len, less);
+                }
+                else ArrInsertion::Sort<T>(src, len, less);
+                return;
+            }
+            ptrdiff_t half = len/2;
+            SortScalar<T>(src, dst, half, !to_dst, less);
+            SortScalar<T>(src+half, dst+half, len-half, !to_dst, less);
+            if(to_dst) Merge<T>(src, half, src+half, len-half, dst, less);
+            else Merge<T>(dst, half, dst+half, len-half, src, less);
+        }
+
+        /**
+        * Sorts src, dst of the same length is used as scratch space.
+        * Specialized for types with vectorized kernels in default ordering, SortScalar otherwise.
+        *
+        * @param to_dst if true, the sorted result is stored in dst, otherwise in src.
+        */
+        template <typename T, typename Compare>
+        void Sort(T* src, T* dst, ptrdiff_t len, bool to_dst, Compare less) { SortScalar<T>(src, dst, len, to_dst, less); }
+
+        /**
+        * Merges the part [k_beg, k_end) of merged a and b into dst, i_beg and i_end are co-ranks of its bounds.
+        */
+        template <typename T, typename Compare>
+        void MergePart(T* a, T* b, T* dst, ptrdiff_t k_beg, ptrdiff_t k_end, ptrdiff_t i_beg, ptrdiff_t i_end, Compare less) {
+            Merge<T>(a+i_beg, i_end-i_beg, b+(k_beg-i_beg), (k_end-i_end)-(k_beg-i_beg), dst+k_beg, less);
+        }
+
+        /**
+        * Merges two sorted arrays into dst using several threads.
+        * Output is split into equal parts, their bounds in a and b are found by CoRank.
+        * T(n) = O(n/p + log(n)), where p is the number of threads.
+        * S(n) = O(p).
+        *
+        * @tparam T must be totally ordered by Compare.
+        * @param threads number of threads to use.
+        */
+        template <typename T, typename Compare>
+        void ParallelMerge(T* a, ptrdiff_t a_len, T* b, ptrdiff_t b_len, T* dst, int threads, Compare less) {
+            ptrdiff_t len = a_len + b_len;
+            if(threads < 2) {
+                Merge<T>(a, a_len, b, b_len, dst, less);
+                return;
+            }
+            // all co-ranks are found before merging starts, merged elements are moved from
+            ptrdiff_t* ranks = new ptrdiff_t[threads+1];
+            for(int p=0; p<=threads; ++p) ranks[p] = CoRank<T>(len * p / threads, a, a_len, b, b_len, less);
+            std::thread* workers = new std::thread[threads-1];
+            for(int p=0; p<threads-1; ++p) {
+                workers[p] = std::thread(MergePart<T, Compare>, a, b, dst, len * p / threads, len * (p+1) / threads,
+                                         ranks[p], ranks[p+1], less);
+            }
+            MergePart<T>(a, b, dst, len * (threads-1) / threads, len, ranks[threads-1], ranks[threads], less);
+            for(int p=0; p<threads-1; ++p) workers[p].join();
+            delete[] workers;
+            delete[] ranks;
         }
-        delete[] t_arr;
+
+        /**
+        * Sorts arr using threads, buf of the same length is used as scratch space.
+        * Halves are sorted into the other array than the result, so every level merges without copying.
+        *
+        * @param to_buf if true, the sorted result is stored in buf, otherwise in arr.
+        */
+        template <typename T, typename Compare>
+        void ParallelSort(T* arr, T* buf, ptrdiff_t len, int threads, int cutoff, bool to_buf, Compare less) {
+            ALGO_STAT_DEPTH;
+            if(threads < 2 || len <= cutoff) {
+                Sort<T>(arr, buf, len, to_buf, less);
+                return;
+            }
+            ptrdiff_t half = len/2;
+            int left_threads = threads/2;
+            std::thread left(ParallelSort<T, Compare>, arr, buf, half, left_threads, cutoff, !to_buf, less);
+            ParallelSort<T>(arr+half, buf+half, len-half, threads-left_threads, cutoff, !to_buf, less);
+            left.join();
+            if(to_buf) ParallelMerge<T>(arr, half, arr+half, len-half, buf, threads, less);
+            else ParallelMerge<T>(buf, half, buf+half, len-half, arr, threads, less);
+        }
+
     }
 
     /**
-    * Find if element is in sorted array, between two indexes. 
-    * T(n) = O(log(n)).
-    * S(n) = O(1).
+    * Sorts array using merge-sort algorithm.
+    * Only one scratch buffer is used, levels of recursion alternate between it and arr.
+    * T(n) = O(n log(n)).
+    * S(n) = O(n), where n is arr size. O(log(n)) if buf is given.
     *
     * @tparam T must be totally ordered and it must have defined >,<,= operators.
-    * @param arr array of elements, must be sorted.
-    * @param target element that is being searched for.
-    * @param beg starting index.
-    * @param beg ending index index.
+    * @param arr array of elements.
+    * @param len length of the array.
+    * @param buf optional scratch array of length at least len, allocated if not given.
+    * @param compare optional strict weak ordering, compare(a, b) is true if a goes before b.
+    * @param projection optional, elements are compared by projection(element).
+    */
+    template <typename T, typename Compare = Less, typename Projection = Identity>
+    void ArrMergeSort(T* arr, ptrdiff_t len, T* buf = NULL, Compare compare = Compare(), Projection projection = Projection()) {
+        if(len < 2) return;
+        T* own_buf = (buf == NULL)? new T[len]: NULL;
+        ALGO_STAT(allocations, own_buf? 1: 0);
+        ArrMerge::Sort<T>(arr, own_buf? own_buf: buf, len, false, MakeOrder(compare, projection));
+        delete[] own_buf;
+    }
+
+    /**
+    * Sorts array using iterative bottom-up merge-sort algorithm.
+    * Runs of INSERTION_SORT_CUTOFF elements are sorted by insertion sort and then merged
+    * pairwise, passes alternate between arr and one scratch buffer.
+    * T(n) = O(n log(n)).
+    * S(n) = O(n), where n is arr size. O(1) if buf is given.
     *
-    * @return value returns True if target is in array, false otherwise 
+    * @tparam T must be totally ordered and it must have defined >,<,= operators.
+    * @param arr array of elements.
+    * @param len length of the array.
+    * @param buf optional scratch array of length at least len, allocated if not given.
+    * @param compare optional strict weak ordering, compare(a, b) is true if a goes before b.
+    * @param projection optional, elements are compared by projection(element).
     */
-    template <typename T>
-    bool BinarySearch(T* arr, T target, int beg, int end) {
-        if(end < beg) return false;
-        int half = (beg+end)/2;
-        if(arr[half] == target) return true;
-        else if(arr[half] > target) return BinarySearch(arr, target, beg, half-1);
-        else return BinarySearch<T>(arr, target, half+1, end);
-    };
+    template <typename T, typename Compare = Less, typename Projection = Identity>
+    void ArrMergeSortBottomUp(T* arr, ptrdiff_t len, T* buf = NULL, Compare compare = Compare(), Projection projection = Projection()) {
+        if(len < 2) return;
+        T* own_buf = (buf == NULL)? new T[len]: NULL;
+        ALGO_STAT(allocations, own_buf? 1: 0);
+        T* src = arr;
+        T* dst = own_buf? own_buf: buf;
+        ptrdiff_t width = ArrMerge::INSERTION_SORT_CUTOFF;
+        for(ptrdiff_t i=0; i<len; i+=width) ArrInsertionSort<T>(arr+i, Min<ptrdiff_t>(width, len-i), compare, projection);
+        for(; width<len; width*=2) {
+            for(ptrdiff_t i=0; i<len; i+=2*width) {
+                ptrdiff_t a_len = Min<ptrdiff_t>(width, len-i);
+                ptrdiff_t b_len = Min<ptrdiff_t>(width, len-i-a_len);
+                ArrMerge::Merge<T>(src+i, a_len, src+i+a_len, b_len, dst+i, MakeOrder(compare, projection));
+            }
+            T* temp = src;
+            src = dst;
+            dst = temp;
+        }
+        if(src != arr) for(ptrdiff_t i=0; i<len; ++i) arr[i] = std::move(src[i]);
+        delete[] own_buf;
+    }
+    
+    /**
+    * Sorts array using parallel merge-sort algorithm.
+    * Recursion is split into tasks for the given number of threads, merges are split by co-rank.
+    * Parts shorter than cutoff are sorted sequentially, result is the same as of ArrMergeSort.
+    * T(n) = O(n log(n) / p + n), where p is the number of threads.
+    * S(n) = O(n), where n is arr size.
+    *
+    * @tparam T must be totally ordered and it must have defined >,<,= operators.
+    * @param arr array of elements.
+    * @param len length of the array.
+    * @param threads number of threads, 0 for the number of hardware threads.
+    * @param cutoff parts of at most this length are sorted sequentially.
+    * @param compare optional strict weak ordering, compare(a, b) is true if a goes before b.
+    * @param projection optional, elements are compared by projection(element).
+    */
+    template <typename T, typename Compare = Less, typename Projection = Identity>
+    void ArrParallelMergeSort(T* arr, ptrdiff_t len, int threads = 0, int cutoff = 1 << 15,
+                              Compare compare = Compare(), Projection projection = Projection()) {
+        if(threads <= 0) threads = (int)std::thread::hardware_concurrency();
+        if(cutoff < 1) cutoff = 1;
+        if(threads < 2 || len <= cutoff) {
+            ArrMergeSort<T>(arr, len, NULL, compare, projection);
+            return;
+        }
+        T* buf = new T[len];
+        ALGO_STAT(allocations, 1);
+        ArrMerge::ParallelSort<T>(arr, buf, len, threads, cutoff, false, MakeOrder(compare, projection));
+        delete[] buf;
+    }
+    
+    
+#ifdef ALGO_SIMD
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpsabi"
+
+    // Vectorized merge sort for int32_t, float and uint64_t.
+    // Kernels are written with GCC vector extensions over 256-bit vectors and compiled for AVX2, SSE4.2
+    // and baseline x86-64, the fastest clone the CPU supports is chosen when the program is loaded.
+    namespace ArrSimd {
+
+        /**
+        * Vector type V of L lanes for elements of type T, I is the vector of lane indices of the same shape,
+        * Lanes sets it to 0, 1, ..., L-1.
+        */
+        template <typename T>
+        struct Vec;
+
+        template <>
+        struct Vec<int32_t> {
+            typedef I32x8 V;
+            typedef I32x8 I;
+            enum { L = 8 };
+            static void Lanes(I& i) { I lanes = {0, 1, 2, 3, 4, 5, 6, 7}; i = lanes; }
+        };
+
+        template <>
+        struct Vec<float> {
+            typedef F32x8 V;
+            typedef I32x8 I;
+            enum { L = 8 };
+            static void Lanes(I& i) { I lanes = {0, 1, 2, 3, 4, 5, 6, 7}; i = lanes; }
+        };
+
+        template <>
+        struct Vec<uint64_t> {
+            typedef U64x4 V;
+            typedef I64x4 I;
+            enum { L = 4 };
+            static void Lanes(I& i) { I lanes = {0, 1, 2, 3}; i = lanes; }
+        };
+
+        /**
+        * Compares every lane with lane (index ^ X), lanes with bit H set in their index keep the larger value,
+        * others the smaller one. One layer of a sorting network.
+        */
+        template <typename T, int X, int H>
+        inline __attribute__((always_inline)) void Exchange(typename Vec<T>::V& v) {
+            typedef typename Vec<T>::V V;
+            typename Vec<T>::I lanes;
+            Vec<T>::Lanes(lanes);
+            V p = __builtin_shuffle(v, lanes ^ X);
+            V min = (v < p)? v: p;
+            V max = (v < p)? p: v;
+            v = (lanes & H)? max: min;
+        }
+
+        /**
+        * Half-cleaner layers S, S/2, ..., 1 of bitonic merge.
+        */
+        template <typename T, int S>
+        struct Clean {
+            static inline __attribute__((always_inline)) void Run(typename Vec<T>::V& v) {
+                Exchange<T, S, S>(v);
+                Clean<T, S/2>::Run(v);
+            }
+        };
+
+        template <typename T>
+        struct Clean<T, 0> {
+            static inline __attribute__((always_inline)) void Run(typename Vec<T>::V&) {}
+        };
+
+        /**
+        * Sorts groups of K lanes by bitonic sorting network.
+        */
+        template <typename T, int K>
+        struct SortLanes {
+            static inline __attribute__((always_inline)) void Run(typename Vec<T>::V& v) {
+                SortLanes<T, K/2>::Run(v);
+                Exchange<T, K-1, K/2>(v);
+                Clean<T, K/4>::Run(v);
+            }
+        };
+
+        template <typename T>
+        struct SortLanes<T, 1> {
+            static inline __attribute__((always_inline)) void Run(typename Vec<T>::V&) {}
+        };
+
+        /**
+        * Merges two sorted vectors by bitonic merge, a gets the smaller half, b the larger.
+        */
+        template <typename T>
+        inline __attribute__((always_inline)) void Merge2(typename Vec<T>::V& a, typename Vec<T>::V& b) {
+            typedef typename Vec<T>::V V;
+            typename Vec<T>::I lanes;
+            Vec<T>::Lanes(lanes);
+            V r = __builtin_shuffle(b, (Vec<T>::L-1) - lanes);
+            V min = (a < r)? a: r;
+            V max = (a < r)? r: a;
+            Clean<T, Vec<T>::L/2>::Run(min);
+            Clean<T, Vec<T>::L/2>::Run(max);
+            a = min;
+            b = max;
+        }
+
+        /**
+        * Scalar merge used for parts shorter than one vector.
+        */
+        template <typename T>
+        inline __attribute__((always_inline)) void MergeScalar(const T* a, ptrdiff_t a_len, const T* b, ptrdiff_t b_len, T* dst) {
+            ptrdiff_t i = 0;
+            ptrdiff_t j = 0;
+            while(i < a_len && j < b_len) *dst++ = (b[j] < a[i])? b[j++]: a[i++];
+            memcpy(dst, a+i, (a_len-i) * sizeof(T));
+            memcpy(dst + (a_len-i), b+j, (b_len-j) * sizeof(T));
+        }
+
+        /**
+        * Merges two sorted arrays into dst. A vector of the smallest unmerged elements is kept in registers,
+        * the next vector is loaded from the array with the smaller next element and both are merged by Merge2.
+        * The rest shorter than one vector is merged by scalar code.
+        */
+        template <typename T>
+        inline __attribute__((always_inline)) void MergeArrays(const T* a, ptrdiff_t a_len, const T* b, ptrdiff_t b_len, T* dst) {
+            typedef typename Vec<T>::V V;
+            const int L = Vec<T>::L;
+            if(a_len < L || b_len < L) {
+                MergeScalar<T>(a, a_len, b, b_len, dst);
+                return;
+            }
+            V next;
+            V carry;
+            memcpy(&next, a, sizeof(V));
+            memcpy(&carry, b, sizeof(V));
+            ptrdiff_t i = L;
+            ptrdiff_t j = L;
+            while(true) {
+                Merge2<T>(next, carry);
+                memcpy(dst, &next, sizeof(V));
+                dst += L;
+                if(i + L > a_len || j + L > b_len) break;
+                if(a[i] < b[j]) {
+                    memcpy(&next, a+i, sizeof(V));
+                    i += L;
+                }
+                else {
+                    memcpy(&next, b+j, sizeof(V));
+                    j += L;
+                }
+            }
+
+            // merge the carried vector with the rests of both arrays
+            T rest[L];
+            memcpy(rest, &carry, sizeof(V));
+            int k = 0;
+            while(k < L && i < a_len && j < b_len) {
+                if(a[i] < rest[k]) *dst++ = (b[j] < a[i])? b[j++]: a[i++];
+                else *dst++ = (b[j] < rest[k])? b[j++]: rest[k++];
+            }
+            if(k == L) MergeScalar<T>(a+i, a_len-i, b+j, b_len-j, dst);
+            else if(i == a_len) MergeScalar<T>(rest+k, L-k, b+j, b_len-j, dst);
+            else MergeScalar<T>(rest+k, L-k, a+i, a_len-i, dst);
+        }
+
+        /**
+        * Sorts src by bottom-up merge sort. Blocks of two vectors are sorted in registers by the sorting network
+        * and bitonic merge, then merged by MergeArrays, passes alternate between src and dst.
+        *
+        * @param to_dst if true, the sorted result is stored in dst, otherwise in src.
+        */
+        template <typename T>
+        inline __attribute__((always_inline)) void Sort(T* src, T* dst, ptrdiff_t len, bool to_dst) {
+            typedef typename Vec<T>::V V;
+            const int L = Vec<T>::L;
+            int block = 2*L;
+            ptrdiff_t i = 0;
+            for(; i + block <= len; i += block) {
+                V a;
+                V b;
+                memcpy(&a, src+i, sizeof(V));
+                memcpy(&b, src+i+L, sizeof(V));
+                SortLanes<T, L>::Run(a);
+                SortLanes<T, L>::Run(b);
+                Merge2<T>(a, b);
+                memcpy(src+i, &a, sizeof(V));
+                memcpy(src+i+L, &b, sizeof(V));
+            }
+            ArrInsertionSort<T>(src+i, len-i);
+
+            T* from = src;
+            T* to = dst;
+            for(ptrdiff_t width=block; width<len; width*=2) {
+                ALGO_STAT(moves, len);
+                for(ptrdiff_t k=0; k<len; k+=2*width) {
+                    ptrdiff_t a_len = Min<ptrdiff_t>(width, len-k);
+                    ptrdiff_t b_len = Min<ptrdiff_t>(width, len-k-a_len);
+                    MergeArrays<T>(from+k, a_len, from+k+a_len, b_len, to+k);
+                }
+                T* temp = from;
+                from = to;
+                to = temp;
+            }
+            if((from == dst) != to_dst) memcpy(to, from, len * sizeof(T));
+        }
+
+        __attribute__((target_clones("avx2", "sse4.2", "default")))
+        inline void SortInt32(int32_t* src, int32_t* dst, ptrdiff_t len, bool to_dst) { Sort<int32_t>(src, dst, len, to_dst); }
+
+        __attribute__((target_clones("avx2", "sse4.2", "default")))
+        inline void SortFloat(float* src, float* dst, ptrdiff_t len, bool to_dst) { Sort<float>(src, dst, len, to_dst); }
+
+        __attribute__((target_clones("avx2", "sse4.2", "default")))
+        inline void SortUInt64(uint64_t* src, uint64_t* dst, ptrdiff_t len, bool to_dst) { Sort<uint64_t>(src, dst, len, to_dst); }
+
+    }
+
+    namespace ArrMerge {
+
+        template <>
+        inline void Sort<int32_t, Less>(int32_t* src, int32_t* dst, ptrdiff_t len, bool to_dst, Less) {
+            ArrSimd::SortInt32(src, dst, len, to_dst);
+        }
+
+        // NaNs are not ordered by vector min/max, arrays containing them are sorted by scalar code
+        template <>
+        inline void Sort<float, Less>(float* src, float* dst, ptrdiff_t len, bool to_dst, Less less) {
+            for(ptrdiff_t i=0; i<len; ++i) {
+                if(src[i] != src[i]) {
+                    SortScalar<float>(src, dst, len, to_dst, less);
+                    return;
+                }
+            }
+            ArrSimd::SortFloat(src, dst, len, to_dst);
+        }
+
+        template <>
+        inline void Sort<uint64_t, Less>(uint64_t* src, uint64_t* dst, ptrdiff_t len, bool to_dst, Less) {
+            ArrSimd::SortUInt64(src, dst, len, to_dst);
+        }
+
+    }
+
+#pragma GCC diagnostic pop
+#endif
+
+    // Operations used by quick sort.
+    namespace ArrQuick {
+
+        // Parts shorter than this are sorted by insertion sort.
+        const int INSERTION_SORT_CUTOFF = 24;
+
+        // Parts longer than this use pseudomedian of nine as pivot.
+        const int NINTHER_CUTOFF = 128;
+
+        // Number of moves after which partial insertion sort gives up.
+        const int PARTIAL_INSERTION_SORT_LIMIT = 8;
+
+        // Number of elements classified at once by block partitioning.
+        const int BLOCK_SIZE = 64;
+
+        /**
+        * Swaps two elements given by pointers.
+        */
+        template <typename T>
+        inline void Swap(T* a, T* b) {
+            ALGO_STAT(swaps, 1);
+            T temp = std::move(*a);
+            *a = std::move(*b);
+            *b = std::move(temp);
+        }
+
+        /**
+        * Sorts three elements, median ends up in b.
+        */
+        template <typename T, typename Compare>
+        inline void Sort3(T* a, T* b, T* c, Compare less) {
+            if(less(*b, *a)) Swap<T>(a, b);
+            if(less(*c, *b)) Swap<T>(b, c);
+            if(less(*b, *a)) Swap<T>(a, b);
+        }
+
+        /**
+        * Insertion sort that expects an element not larger than all elements of [begin, end) before begin.
+        */
+        template <typename T, typename Compare>
+        void UnguardedInsertionSort(T* begin, T* end, Compare less) {
+            for(T* cur = begin+1; cur < end; ++cur) {
+                if(less(*cur, *(cur-1))) {
+                    T temp = std::move(*cur);
+                    T* sift = cur;
+                    do {
+                        *sift = std::move(*(sift-1));
+                        --sift;
+                    } while(less(temp, *(sift-1)));
+                    *sift = std::move(temp);
+                }
+            }
+        }
+
+        /**
+        * Insertion sort that gives up after PARTIAL_INSERTION_SORT_LIMIT moves.
+        * Returns true if the part was sorted.
+        */
+        template <typename T, typename Compare>
+        bool PartialInsertionSort(T* begin, T* end, Compare less) {
+            ptrdiff_t moves = 0;
+            for(T* cur = begin+1; cur < end; ++cur) {
+                if(less(*cur, *(cur-1))) {
+                    T temp = std::move(*cur);
+                    T* sift = cur;
+                    do {
+                        *sift = std::move(*(sift-1));
+                        --sift;
+                    } while(sift != begin && less(temp, *(sift-1)));
+                    *sift = std::move(temp);
+                    moves += cur - sift;
+                }
+                if(moves > PARTIAL_INSERTION_SORT_LIMIT) return false;
+            }
+            return true;
+        }
+
+        /**
+        * Partitions [begin, end) around pivot *begin, elements equal to pivot go to the left.
+        * Used when the pivot is equal to the element before begin, so the left part is all equal to pivot.
+        * Returns the position of the pivot.
+        */
+        template <typename T, typename Compare>
+        T* PartitionLeft(T* begin, T* end, Compare less) {
+            T pivot = std::move(*begin);
+            T* first = begin;
+            T* last = end;
+            // *begin was moved from, so it cannot serve as the sentinel of the first scan
+            do --last; while(last > begin && less(pivot, *last));
+            if(last+1 == end) while(first < last && !(less(pivot, *++first)));
+            else while(!(less(pivot, *++first)));
+            while(first < last) {
+                Swap<T>(first, last);
+                while(less(pivot, *--last));
+                while(!(less(pivot, *++first)));
+            }
+            // the pivot may stay at begin, moving an element onto itself is avoided
+            if(last != begin) *begin = std::move(*last);
+            *last = std::move(pivot);
+            return last;
+        }
+
+        /**
+        * Partitions [begin, end) around pivot *begin, elements equal to pivot go to the right.
+        * Elements are classified in blocks of BLOCK_SIZE, offsets of misplaced elements are stored
+        * without branching on the comparison and then swapped in pairs.
+        * Returns the position of the pivot, already_partitioned is set if no element had to be moved.
+        */
+        template <typename T, typename Compare>
+        T* PartitionRight(T* begin, T* end, bool* already_partitioned, Compare less) {
+            T pivot = std::move(*begin);
+            T* first = begin;
+            T* last = end;
+            // find the first element not smaller than pivot, median of three guards the scan
+            while(less(*++first, pivot));
+            if(first-1 == begin) while(first < last && !(less(*--last, pivot)));
+            else while(!(less(*--last, pivot)));
+            *already_partitioned = first >= last;
+
+            if(!*already_partitioned) {
+                Swap<T>(first, last);
+                ++first;
+
+                unsigned char offsets_l[BLOCK_SIZE];
+                unsigned char offsets_r[BLOCK_SIZE];
+                T* base_l = first;
+                T* base_r = last;
+                int num_l = 0;
+                int num_r = 0;
+                int start_l = 0;
+                int start_r = 0;
+                while(first < last) {
+                    // fill the empty block, split the unknown part between both if both are empty
+                    ptrdiff_t unknown = last - first;
+                    ptrdiff_t split_l = (num_l == 0)? ((num_r == 0)? unknown/2: unknown): 0;
+                    ptrdiff_t split_r = (num_r == 0)? unknown - split_l: 0;
+                    split_l = Min<ptrdiff_t>(split_l, BLOCK_SIZE);
+                    split_r = Min<ptrdiff_t>(split_r, BLOCK_SIZE);
+                    for(int i=0; i<split_l; ++i) {
+                        offsets_l[num_l] = (unsigned char)i;
+                        num_l += !(less(*first, pivot));
+                        ++first;
+                    }
+                    for(int i=1; i<=split_r; ++i) {
+                        offsets_r[num_r] = (unsigned char)i;
+                        num_r += (less(*--last, pivot));
+                    }
+
+                    // swap misplaced pairs, using a cycle of moves instead of swaps when possible
+                    int num = Min<int>(num_l, num_r);
+                    if(num > 0) {
+                        T* l = base_l + offsets_l[start_l];
+                        T* r = base_r - offsets_r[start_r];
+                        T temp = std::move(*l);
+                        *l = std::move(*r);
+                        for(int i=1; i<num; ++i) {
+                            l = base_l + offsets_l[start_l+i];
+                            *r = std::move(*l);
+                            r = base_r - offsets_r[start_r+i];
+                            *l = std::move(*r);
+                        }
+                        *r = std::move(temp);
+                    }
+                    num_l -= num;
+                    num_r -= num;
+                    start_l += num;
+                    start_r += num;
+                    if(num_l == 0) {
+                        start_l = 0;
+                        base_l = first;
+                    }
+                    if(num_r == 0) {
+                        start_r = 0;
+                        base_r = last;
+                    }
+                }
+
+                // move remaining misplaced elements of one block next to the boundary
+                if(num_l) {
+                    while(num_l--) {
+                        --last;
+                        Swap<T>(last, base_l + offsets_l[start_l+num_l]);
+                    }
+                    first = last;
+                }
+                if(num_r) {
+                    while(num_r--) {
+                        Swap<T>(first, base_r - offsets_r[start_r+num_r]);
+                        ++first;
+                    }
+                    last = first;
+                }
+            }
+
+            T* pivot_pos = first-1;
+            if(pivot_pos != begin) *begin = std::move(*pivot_pos);
+            *pivot_pos = std::move(pivot);
+            return pivot_pos;
+        }
+
+        /**
+        * Swaps elements at positions given as offsets from both ends of the part, breaks patterns
+        * that lead to unbalanced partitions.
+        */
+        template <typename T>
+        void BreakPatterns(T* begin, T* end) {
+            ptrdiff_t size = end - begin;
+            if(size < INSERTION_SORT_CUTOFF) return;
+            ArrSwap<T>(begin, 0, size/4);
+            ArrSwap<T>(begin, size-1, size-size/4);
+            if(size > NINTHER_CUTOFF) {
+                ArrSwap<T>(begin, 1, size/4+1);
+                ArrSwap<T>(begin, 2, size/4+2);
+                ArrSwap<T>(begin, size-2, size-size/4-1);
+                ArrSwap<T>(begin, size-3, size-size/4-2);
+            }
+        }
+
+        /**
+        * Sorts [begin, end) by pattern-defeating quick sort.
+        *
+        * @param bad_allowed number of unbalanced partitions after which heap sort is used.
+        * @param leftmost is true if there is no element before begin that is not larger than all elements of the part.
+        */
+        template <typename T, typename Compare>
+        void Sort(T* begin, T* end, int bad_allowed, bool leftmost, Compare less) {
+            ALGO_STAT_DEPTH;
+            while(true) {
+                ptrdiff_t size = end - begin;
+                if(size < INSERTION_SORT_CUTOFF) {
+                    if(leftmost) ArrInsertion::Sort<T>(begin, size, less);
+                    else UnguardedInsertionSort<T>(begin, end, less);
+                    return;
+                }
+
+                // choose pivot as median of three or pseudomedian of nine and move it to begin
+                ptrdiff_t half = size/2;
+                if(size > NINTHER_CUTOFF) {
+                    Sort3<T>(begin, begin+half, end-1, less);
+                    Sort3<T>(begin+1, begin+half-1, end-2, less);
+                    Sort3<T>(begin+2, begin+half+1, end-3, less);
+                    Sort3<T>(begin+half-1, begin+half, begin+half+1, less);
+                    ArrSwap<T>(begin, 0, half);
+                }
+                else Sort3<T>(begin+half, begin, end-1, less);
+
+                // pivot equal to the element before the part means many equal elements,
+                // put them to the left and continue only with the larger ones
+                if(!leftmost && !less(*(begin-1), *begin)) {
+                    begin = PartitionLeft<T>(begin, end, less) + 1;
+                    continue;
+                }
+
+                bool already_partitioned;
+                T* pivot_pos = PartitionRight<T>(begin, end, &already_partitioned, less);
+                ptrdiff_t l_size = pivot_pos - begin;
+                ptrdiff_t r_size = end - (pivot_pos+1);
+
+                if(l_size < size/8 || r_size < size/8) {
+                    if(--bad_allowed == 0) {
+                        ArrHeap::Sort<T, 4>(begin, size, less);
+                        return;
+                    }
+                    BreakPatterns<T>(begin, pivot_pos);
+                    BreakPatterns<T>(pivot_pos+1, end);
+                }
+                // partition with no moves suggests sorted input, try to finish it cheaply
+                else if(already_partitioned && PartialInsertionSort<T>(begin, pivot_pos, less)
+                        && PartialInsertionSort<T>(pivot_pos+1, end, less)) return;
+
+                // recurse into the left part, loop on the right one
+                Sort<T>(begin, pivot_pos, bad_allowed, leftmost, less);
+                begin = pivot_pos+1;
+                leftmost = false;
+            }
+        }
+
+    }
+
+    /**
+    * Sorts array using pattern-defeating quick-sort algorithm (introsort variant).
+    * Pivot is median of three or pseudomedian of nine, partitioning is branchless in blocks, short parts
+    * are sorted by insertion sort. Sorted, reversed and many-duplicates inputs take O(n), after too many
+    * unbalanced partitions the part is sorted by ArrHeapSort, so O(n log(n)) is guaranteed.
+    * T(n) = O(n log(n)).
+    * S(n) = O(log(n)), where n is arr size.
+    *
+    * @tparam T must be totally ordered and it must have defined >,<,= operators.
+    * @param arr array of elements.
+    * @param len length of the array.
+    * @param compare optional strict weak ordering, compare(a, b) is true if a goes before b.
+    * @param projection optional, elements are compared by projection(element).
+    */
+    template <typename T, typename Compare = Less, typename Projection = Identity>
+    void ArrQuickSort(T* arr, ptrdiff_t len, Compare compare = Compare(), Projection projection = Projection()) {
+        if(len < 2) return;
+        int log = 0;
+        for(ptrdiff_t i=len; i>1; i/=2) ++log;
+        ArrQuick::Sort<T>(arr, arr+len, log, true, MakeOrder(compare, projection));
+    }
+
+
+    // Operations used by selection, partial sort and top-k.
+    namespace ArrSelect {
+
+        // Partial sort selects by heap if k is at most len / HEAP_SELECT_RATIO, by introselect otherwise.
+        const int HEAP_SELECT_RATIO = 64;
+
+        /**
+        * Adds value to bounded heap of the k largest elements seen so far.
+        * The heap is minimal in less, so its top is the smallest kept element and most values
+        * are rejected by one comparison with it.
+        * T(n) = O(log(k)).
+        * S(n) = O(1).
+        *
+        * @param heap array of at least k elements.
+        * @param heap_len number of kept elements, it is updated.
+        * @param value added element, it is copied into the heap, or moved if it is an rvalue.
+        */
+        template <typename T, typename U, typename Compare>
+        void Push(T* heap, ptrdiff_t* heap_len, ptrdiff_t k, U&& value, Compare less) {
+            if(*heap_len < k) {
+                heap[*heap_len] = std::forward<U>(value);
+                ArrHeap::SiftUp<T, 4>(heap, (*heap_len)++, Reversed<Compare>(less));
+            }
+            else if(k > 0 && less(heap[0], value)) {
+                heap[0] = std::forward<U>(value);
+                ArrHeap::SiftDown<T, 4>(heap, k, 0, Reversed<Compare>(less));
+            }
+        }
+
+        /**
+        * Moves the k smallest elements of [begin, end) to its beginning, as a maximal heap.
+        * T(n) = O(n log(k)).
+        * S(n) = O(1).
+        */
+        template <typename T, typename Compare>
+        void HeapSelect(T* begin, T* end, ptrdiff_t k, Compare less) {
+            ArrHeap::Build<T, 4>(begin, k, less);
+            for(T* cur = begin+k; cur < end; ++cur) {
+                if(less(*cur, *begin)) {
+                    ArrQuick::Swap<T>(cur, begin);
+                    ArrHeap::SiftDown<T, 4>(begin, k, 0, less);
+                }
+            }
+        }
+
+        /**
+        * Introselect, quick select with the pivot choice and partitioning of ArrQuick.
+        * Only the part containing nth is partitioned further, after too many unbalanced partitions
+        * the rest is selected by HeapSelect.
+        *
+        * @param bad_allowed number of unbalanced partitions after which heap select is used.
+        */
+        template <typename T, typename Compare>
+        void NthElement(T* begin, T* end, T* nth, int bad_allowed, Compare less) {
+            bool leftmost = true;
+            while(true) {
+                ptrdiff_t size = end - begin;
+                if(size < ArrQuick::INSERTION_SORT_CUTOFF) {
+                    ArrInsertion::Sort<T>(begin, size, less);
+                    return;
+                }
+
+                ptrdiff_t half = size/2;
+                if(size > ArrQuick::NINTHER_CUTOFF) {
+                    ArrQuick::Sort3<T>(begin, begin+half, end-1, less);
+                    ArrQuick::Sort3<T>(begin+1, begin+half-1, end-2, less);
+                    ArrQuick::Sort3<T>(begin+2, begin+half+1, end-3, less);
+                    ArrQuick::Sort3<T>(begin+half-1, begin+half, begin+half+1, less);
+                    ArrSwap<T>(begin, 0, half);
+                }
+                else ArrQuick::Sort3<T>(begin+half, begin, end-1, less);
+
+                // pivot equal to the element before the part, elements equal to it are moved left and are done
+                if(!leftmost && !less(*(begin-1), *begin)) {
+                    T* last = ArrQuick::PartitionLeft<T>(begin, end, less);
+                    if(nth <= last) return;
+                    begin = last+1;
+                    continue;
+                }
+
+                bool already_partitioned;
+                T* pivot_pos = ArrQuick::PartitionRight<T>(begin, end, &already_partitioned, less);
+                if(pivot_pos == nth) return;
+                ptrdiff_t l_size = pivot_pos - begin;
+                ptrdiff_t r_size = end - (pivot_pos+1);
+                if(l_size < size/8 || r_size < size/8) {
+                    if(--bad_allowed == 0) {
+                        HeapSelect<T>(begin, end, (nth - begin) + 1, less);
+                        ArrQuick::Swap<T>(begin, nth);
+                        return;
+                    }
+                    ArrQuick::BreakPatterns<T>(begin, pivot_pos);
+                    ArrQuick::BreakPatterns<T>(pivot_pos+1, end);
+                }
+
+                if(nth < pivot_pos) end = pivot_pos;
+                else {
+                    begin = pivot_pos+1;
+                    leftmost = false;
+                }
+            }
+        }
+
+    }
+
+    /**
+    * Rearranges array so that arr[nth] is the element that would be there if the array was sorted,
+    * elements before it are not larger and elements after it are not smaller.
+    * Introselect, quick select that falls back to heap select after too many unbalanced partitions.
+    * T(n) = O(n) expected, O(n log(n)) worst case.
+    * S(n) = O(1).
+    *
+    * @tparam T must be totally ordered and it must have defined >,<,= operators.
+    * @param arr array of elements.
+    * @param len length of the array.
+    * @param nth index of the selected element, 0 <= nth < len.
+    * @param compare optional strict weak ordering, compare(a, b) is true if a goes before b.
+    * @param projection optional, elements are compared by projection(element).
+    */
+    template <typename T, typename Compare = Less, typename Projection = Identity>
+    void ArrNthElement(T* arr, ptrdiff_t len, ptrdiff_t nth, Compare compare = Compare(), Projection projection = Projection()) {
+        if(nth < 0 || nth >= len) return;
+        int log = 0;
+        for(ptrdiff_t i=len; i>1; i/=2) ++log;
+        ArrSelect::NthElement<T>(arr, arr+len, arr+nth, log+1, MakeOrder(compare, projection));
+    }
+
+    /**
+    * Sorts the k smallest elements of array to its beginning, order of the rest is unspecified.
+    * For small k the elements are selected by a bounded heap, otherwise by ArrNthElement.
+    * T(n) = O(n log(k)) for small k, O(n + k log(k)) expected otherwise.
+    * S(n) = O(log(k)).
+    *
+    * @tparam T must be totally ordered and it must have defined >,<,= operators.
+    * @param arr array of elements.
+    * @param len length of the array.
+    * @param k number of sorted elements.
+    * @param compare optional strict weak ordering, compare(a, b) is true if a goes before b.
+    * @param projection optional, elements are compared by projection(element).
+    */
+    template <typename T, typename Compare = Less, typename Projection = Identity>
+    void ArrPartialSort(T* arr, ptrdiff_t len, ptrdiff_t k, Compare compare = Compare(), Projection projection = Projection()) {
+        if(k <= 0) return;
+        if(k >= len) {
+            ArrQuickSort<T>(arr, len, compare, projection);
+            return;
+        }
+        if(k <= len / ArrSelect::HEAP_SELECT_RATIO) {
+            ArrSelect::HeapSelect<T>(arr, arr+len, k, MakeOrder(compare, projection));
+            ArrHeap::SortHeap<T, 4>(arr, k, MakeOrder(compare, projection));
+        }
+        else {
+            ArrNthElement<T>(arr, len, k-1, compare, projection);
+            ArrQuickSort<T>(arr, k-1, compare, projection);
+        }
+    }
+
+    /**
+    * Finds the k largest elements of array, arr itself is not changed.
+    * Elements are passed through a bounded heap of k elements, see TopK for a stream version.
+    * T(n) = O(n log(k)), O(n + k log(k) log(n)) expected for random order.
+    * S(n) = O(1).
+    *
+    * @tparam T must be totally ordered and it must have defined >,<,= operators.
+    * @param arr array of elements.
+    * @param len length of the array.
+    * @param k number of wanted elements.
+    * @param out array of length k, the largest elements will be assigned to it from the largest.
+    * @param compare optional strict weak ordering, compare(a, b) is true if a goes before b.
+    * @param projection optional, elements are compared by projection(element).
+    * @return number of elements assigned to out, Min(k, len).
+    */
+    template <typename T, typename Compare = Less, typename Projection = Identity>
+    ptrdiff_t ArrTopK(T* arr, ptrdiff_t len, ptrdiff_t k, T* out, Compare compare = Compare(), Projection projection = Projection()) {
+        ptrdiff_t heap_len = 0;
+        for(ptrdiff_t i=0; i<len; ++i) ArrSelect::Push<T>(out, &heap_len, k, arr[i], MakeOrder(compare, projection));
+        ArrHeap::SortHeap<T, 4>(out, heap_len, MakeOrder(Reversed<Compare>(compare), projection));
+        return heap_len;
+    }
+
+    /**
+    * The k largest elements of a stream, kept in a bounded heap.
+    * Elements can be added one by one as they arrive and the current result read at any time.
+    *
+    * @tparam T must be totally ordered and it must have defined >,<,= operators.
+    * @tparam Compare strict weak ordering, compare(a, b) is true if a goes before b.
+    * @tparam Projection elements are compared by projection(element).
+    */
+    template <typename T, typename Compare = Less, typename Projection = Identity>
+    class TopK {
+        public:
+            TopK(ptrdiff_t k, Compare compare = Compare(), Projection projection = Projection())
+                : k(Max<ptrdiff_t>(k, 0)), length(0), heap(new T[Max<ptrdiff_t>(k, 1)]), order(compare, projection) {}
+
+            ~TopK() { delete[] heap; }
+
+            /**
+            * Adds element from the stream.
+            * T(n) = O(log(k)), O(1) if the element is smaller than all kept ones.
+            * S(n) = O(1).
+            *
+            * @param value added element.
+            */
+            void Push(const T& value) { ArrSelect::Push<T>(heap, &length, k, value, order); }
+
+            /**
+            * Moves element from the stream into the kept ones, it is moved from only if it is kept.
+            * T(n) = O(log(k)), O(1) if the element is smaller than all kept ones.
+            * S(n) = O(1).
+            *
+            * @param value added element.
+            */
+            void Push(T&& value) { ArrSelect::Push<T>(heap, &length, k, std::move(value), order); }
+
+            /**
+            * Returns the smallest kept element, the k-th largest so far. TopK must not be empty.
+            * T(n) = O(1).
+            * S(n) = O(1).
+            */
+            const T& Threshold() { return heap[0]; }
+
+            /**
+            * Assigns the kept elements to out from the largest.
+            * T(n) = O(k log(k)).
+            * S(n) = O(1).
+            *
+            * @param out array of length at least Length().
+            * @return number of assigned elements.
+            */
+            ptrdiff_t Extract(T* out) {
+                for(ptrdiff_t i=0; i<length; ++i) out[i] = heap[i];
+                ArrHeap::SortHeap<T, 4>(out, length, Reversed<Projected<Compare, Projection> >(order));
+                return length;
+            }
+
+            /**
+            * Returns number of kept elements, Min(k, number of added elements).
+            */
+            ptrdiff_t Length() { return length; }
+
+            /**
+            * Removes all kept elements.
+            */
+            void Clear() { length = 0; }
+
+        private:
+            ptrdiff_t k;
+            ptrdiff_t length;
+            T* heap;
+            Projected<Compare, Projection> order;
+
+            TopK(const TopK&);
+            TopK& operator=(const TopK&);
+    };
+
+
+    // Operations used by count sorts.
+    namespace ArrCounting {
+
+        /**
+        * Number of threads for array of len elements with t_len distinct keys. Each thread gets at least
+        * ArrParallel::CHUNK_LEN elements and its histogram is not longer than its part of the array.
+        */
+        inline int Threads(ptrdiff_t len, ptrdiff_t t_len, int threads) {
+            if(threads <= 0) threads = (int)std::thread::hardware_concurrency();
+            ptrdiff_t limit = Min<ptrdiff_t>(len / ArrParallel::CHUNK_LEN, len / t_len);
+            return (int)Max<ptrdiff_t>(1, Min<ptrdiff_t>(threads, limit));
+        }
+
+        /**
+        * Runs task(t, threads) for t = 0, ..., threads-1, task 0 is run by the calling thread.
+        */
+        template <typename Task>
+        void Run(Task task, int threads) {
+            std::thread* workers = new std::thread[threads];
+            for(int t=1; t<threads; ++t) workers[t] = std::thread(task, t, threads);
+            task(0, threads);
+            for(int t=1; t<threads; ++t) workers[t].join();
+            delete[] workers;
+        }
+
+        /**
+        * Beginning of part t of [0, len) split into threads parts.
+        */
+        inline ptrdiff_t Part(ptrdiff_t len, int t, int threads) { return len * t / threads; }
+
+        struct Range {
+            ptrdiff_t min;
+            ptrdiff_t max;
+        };
+
+        /**
+        * Range of values of chunk, by vectorized ArrMinMax.
+        */
+        struct MinMax {
+            Range operator()(int* arr, ptrdiff_t beg, ptrdiff_t end) const {
+                int min, max;
+                ArrMinMax<int>(arr+beg, end-beg, &min, &max);
+                Range range = {min, max};
+                return range;
+            }
+        };
+
+        /**
+        * Range of keys of chunk.
+        */
+        template <typename Key>
+        struct KeyRange {
+            Key key;
+            KeyRange(Key k): key(k) {}
+            template <typename T>
+            Range operator()(T* arr, ptrdiff_t beg, ptrdiff_t end) const {
+                Range range = {(ptrdiff_t)key(arr[beg]), (ptrdiff_t)key(arr[beg])};
+                for(ptrdiff_t i=beg+1; i<end; ++i) {
+                    ptrdiff_t k = (ptrdiff_t)key(arr[i]);
+                    if(k < range.min) range.min = k;
+                    if(k > range.max) range.max = k;
+                }
+                return range;
+            }
+        };
+
+        struct RangeCombine {
+            Range operator()(const Range& a, const Range& b) const {
+                Range range = {Min(a.min, b.min), Max(a.max, b.max)};
+                return range;
+            }
+        };
+
+        /**
+        * Task counting keys from [min, min + t_len) of part t of the array into histogram t of counts.
+        */
+        template <typename T, typename C, typename Key>
+        struct Histogram {
+            T* arr;
+            ptrdiff_t len;
+            Key key;
+            ptrdiff_t min;
+            ptrdiff_t t_len;
+            C* counts;
+            Histogram(T* a, ptrdiff_t l, Key k, ptrdiff_t m, ptrdiff_t t, C* c): arr(a), len(l), key(k), min(m), t_len(t), counts(c) {}
+            void operator()(int t, int threads) const {
+                C* hist = counts + t * t_len;
+                for(ptrdiff_t v=0; v<t_len; ++v) hist[v] = 0;
+                ptrdiff_t end = Part(len, t+1, threads);
+                for(ptrdiff_t i=Part(len, t, threads); i<end; ++i) ++hist[(ptrdiff_t)key(arr[i]) - min];
+            }
+        };
+
+        /**
+        * Task adding part t of the values of all histograms to the first one.
+        */
+        template <typename C>
+        struct Combine {
+            C* counts;
+            ptrdiff_t t_len;
+            int hists;
+            Combine(C* c, ptrdiff_t t, int h): counts(c), t_len(t), hists(h) {}
+            void operator()(int t, int threads) const {
+                ptrdiff_t end = Part(t_len, t+1, threads);
+                for(int h=1; h<hists; ++h) {
+                    C* hist = counts + h * t_len;
+                    for(ptrdiff_t v=Part(t_len, t, threads); v<end; ++v) counts[v] += hist[v];
+                }
+            }
+        };
+
+        /**
+        * Task writing part t of the sorted array, ends[v] is the end of the run of value min + v.
+        * Runs are written whole, so empty values cost one step each, not one per element.
+        */
+        template <typename C>
+        struct Fill {
+            int* arr;
+            ptrdiff_t len;
+            int min;
+            const C* ends;
+            ptrdiff_t t_len;
+            Fill(int* a, ptrdiff_t l, int m, const C* e, ptrdiff_t t): arr(a), len(l), min(m), ends(e), t_len(t) {}
+            void operator()(int t, int threads) const {
+                ptrdiff_t beg = Part(len, t, threads);
+                ptrdiff_t end = Part(len, t+1, threads);
+                // first value whose run ends after beg
+                ptrdiff_t lo = 0, hi = t_len;
+                while(lo < hi) {
+                    ptrdiff_t mid = lo + (hi - lo) / 2;
+                    if(ends[mid] > beg) hi = mid;
+                    else lo = mid + 1;
+                }
+                for(ptrdiff_t i=beg, v=lo; i<end; ++v) {
+                    ptrdiff_t stop = Min<ptrdiff_t>(ends[v], end);
+                    for(; i<stop; ++i) arr[i] = (int)(v + min);
+                }
+            }
+        };
+
+        /**
+        * Task moving part t of the array to out, histogram t of offsets holds the next position of each key.
+        * Elements are moved, arr is left in moved-from state.
+        */
+        template <typename T, typename C, typename Key>
+        struct Scatter {
+            T* arr;
+            ptrdiff_t len;
+            Key key;
+            ptrdiff_t min;
+            ptrdiff_t t_len;
+            C* offsets;
+            T* out;
+            Scatter(T* a, ptrdiff_t l, Key k, ptrdiff_t m, ptrdiff_t t, C* o, T* b): arr(a), len(l), key(k), min(m), t_len(t), offsets(o), out(b) {}
+            void operator()(int t, int threads) const {
+                C* next = offsets + t * t_len;
+                ptrdiff_t end = Part(len, t+1, threads);
+                for(ptrdiff_t i=Part(len, t, threads); i<end; ++i) out[next[(ptrdiff_t)key(arr[i]) - min]++] = std::move(arr[i]);
+            }
+        };
+
+        /**
+        * Task moving part t of from to to.
+        */
+        template <typename T>
+        struct Copy {
+            T* from;
+            T* to;
+            ptrdiff_t len;
+            Copy(T* f, T* t, ptrdiff_t l): from(f), to(t), len(l) {}
+            void operator()(int t, int threads) const {
+                ptrdiff_t end = Part(len, t+1, threads);
+                for(ptrdiff_t i=Part(len, t, threads); i<end; ++i) to[i] = std::move(from[i]);
+            }
+        };
+
+        /**
+        * Sorts array of values from [min, min + t_len) by counts of type C.
+        * Counts of type int are enough for arrays shorter than 2^31 and keep the count array half as large.
+        */
+        template <typename C>
+        void Sort(int* arr, ptrdiff_t len, int min, ptrdiff_t t_len, int threads) {
+            C* counts = new C[t_len * threads];
+            ALGO_STAT(allocations, 1);
+            ALGO_STAT(moves, len);
+            Run(Histogram<int, C, Identity>(arr, len, Identity(), min, t_len, counts), threads);
+            if(threads > 1) {
+                Run(Combine<C>(counts, t_len, threads), threads);
+                for(ptrdiff_t v=1; v<t_len; ++v) counts[v] += counts[v-1];
+                Run(Fill<C>(arr, len, min, counts, t_len), threads);
+            } else {
+                for(ptrdiff_t v=0, i=0; v<t_len; ++v) {
+                    for(C c=counts[v]; c>0; --c) arr[i++] = (int)(v + min);
+                }
+            }
+            delete[] counts;
+        }
+
+        /**
+        * Stable sort of array by keys from [min, min + t_len) through buf, counts of type C.
+        */
+        template <typename T, typename C, typename Key>
+        void SortBy(T* arr, ptrdiff_t len, Key key, ptrdiff_t min, ptrdiff_t t_len, T* buf, int threads) {
+            C* counts = new C[t_len * threads];
+            ALGO_STAT(allocations, 1);
+            ALGO_STAT(moves, 2 * len);
+            Run(Histogram<T, C, Key>(arr, len, key, min, t_len, counts), threads);
+            // elements of part t go after equal keys of the parts before it, so the order of equal keys is kept
+            C offset = 0;
+            for(ptrdiff_t v=0; v<t_len; ++v) {
+                for(int t=0; t<threads; ++t) {
+                    C count = counts[t * t_len + v];
+                    counts[t * t_len + v] = offset;
+                    offset += count;
+                }
+            }
+            Run(Scatter<T, C, Key>(arr, len, key, min, t_len, counts, buf), threads);
+            Run(Copy<T>(buf, arr, len), threads);
+            delete[] counts;
+        }
+
+    }
+
+    /**
+    * Sorts array using count-sort algorithm by several threads. Each thread counts the values of its
+    * part of the array into its own histogram, the histograms are summed and the threads write the
+    * runs of values into their parts of the array. Each thread gets at least ArrParallel::CHUNK_LEN
+    * elements and no more values than elements, so short arrays and wide ranges use fewer threads.
+    * T(n) = O((n + m) / p + m), where p is the number of threads.
+    * S(n) = O(pm), where n is arr size and m = Max(arr) - Min(arr)
+    *
+    * @param arr array of elements.
+    * @param len length of the array.
+    * @param threads number of threads, 0 for the number of hardware threads.
+    */
+    inline void ArrParallelCountSort(int* arr, ptrdiff_t len, int threads = 0) {
+        if(len < 1) return;
+        ArrCounting::Range range = ArrParallel::Reduce<int, ArrCounting::Range>(arr, len, ArrCounting::MinMax(), ArrCounting::RangeCombine(), threads);
+        ptrdiff_t t_len = range.max - range.min + 1;
+        threads = ArrCounting::Threads(len, t_len, threads);
+        if(len <= INT32_MAX) ArrCounting::Sort<int>(arr, len, (int)range.min, t_len, threads);
+        else ArrCounting::Sort<ptrdiff_t>(arr, len, (int)range.min, t_len, threads);
+    }
+
+    /**
+    * Sorts array using count-sort algorithm.
+    * T(n) = O(n + m).
+    * S(n) = O(m), where n is arr size and m = Max(arr) - Min(arr)
+    *
+    * @param arr array of elements.
+    * @param len length of the array.
+    */
+    inline void CountSort(int* arr, ptrdiff_t len) { ArrParallelCountSort(arr, len, 1); }
+
+    /**
+    * Stable sort of records by small integer keys using count-sort algorithm by several threads.
+    * Each thread counts the keys of its part of the array, prefix sums over keys and parts give
+    * every thread its positions and the threads move their records to buf and back in parallel.
+    * Records with equal keys keep their order.
+    * T(n) = O((n + m) / p + pm), where p is the number of threads.
+    * S(n) = O(n + pm), where n is arr size and m = Max(key) - Min(key), O(pm) if buf is given.
+    *
+    * @tparam T type of records, copy assignable.
+    * @tparam Key key(x) of integral type, e.g. Member(&Record::key).
+    * @param arr array of records.
+    * @param len length of the array.
+    * @param key gives key of a record.
+    * @param buf buffer of len records, allocated if NULL.
+    * @param threads number of threads, 0 for the number of hardware threads.
+    */
+    template <typename T, typename Key>
+    void ArrCountSortBy(T* arr, ptrdiff_t len, Key key, T* buf = NULL, int threads = 0) {
+        if(len < 2) return;
+        ArrCounting::Range range = ArrParallel::Reduce<T, ArrCounting::Range>(arr, len, ArrCounting::KeyRange<Key>(key), ArrCounting::RangeCombine(), threads);
+        ptrdiff_t t_len = range.max - range.min + 1;
+        threads = ArrCounting::Threads(len, t_len, threads);
+        T* b = buf? buf: new T[len];
+        ALGO_STAT(allocations, buf? 0: 1);
+        if(len <= INT32_MAX) ArrCounting::SortBy<T, int, Key>(arr, len, key, range.min, t_len, b, threads);
+        else ArrCounting::SortBy<T, ptrdiff_t, Key>(arr, len, key, range.min, t_len, b, threads);
+        if(!buf) delete[] b;
+    }
+
+    // Operations used by radix sorts.
+    namespace ArrRadix {
+
+        /**
+        * Maps keys to unsigned integers of the same size with the same order.
+        * Signed integers get their sign bit flipped, negative floats all bits, non-negative floats the sign bit.
+        */
+        template <typename T>
+        struct Key;
+
+        template <>
+        struct Key<uint32_t> {
+            typedef uint32_t U;
+            static U Get(uint32_t x) { return x; }
+        };
+
+        template <>
+        struct Key<int32_t> {
+            typedef uint32_t U;
+            static U Get(int32_t x) { return (U)x ^ 0x80000000u; }
+        };
+
+        template <>
+        struct Key<uint64_t> {
+            typedef uint64_t U;
+            static U Get(uint64_t x) { return x; }
+        };
+
+        template <>
+        struct Key<int64_t> {
+            typedef uint64_t U;
+            static U Get(int64_t x) { return (U)x ^ 0x8000000000000000ull; }
+        };
+
+        template <>
+        struct Key<float> {
+            typedef uint32_t U;
+            static U Get(float x) {
+                U u;
+                memcpy(&u, &x, sizeof(u));
+                return u ^ (((U)0 - (u >> 31)) | 0x80000000u);
+            }
+        };
+
+        template <>
+        struct Key<double> {
+            typedef uint64_t U;
+            static U Get(double x) {
+                U u;
+                memcpy(&u, &x, sizeof(u));
+                return u ^ (((U)0 - (u >> 63)) | 0x8000000000000000ull);
+            }
+        };
+
+        /**
+        * Sorts array by LSD radix sort, 11-bit digits for 32-bit keys and 8-bit digits for 64-bit keys.
+        * Histograms of all digits are counted in one pass, digits that are the same for all elements are skipped.
+        * Passes alternate between arr and buf.
+        * T(n) = O(n * k), where k is the number of digits.
+        * S(n) = O(2^d * k), where d is the number of bits in one digit.
+        *
+        * @tparam T one of the types Key is defined for.
+        * @tparam C type of the histogram counts, int for arrays shorter than 2^31 keeps them in L1 cache.
+        * @param arr array of elements.
+        * @param len length of the array.
+        * @param buf scratch array of length at least len.
+        */
+        template <typename T, typename C>
+        void Sort(T* arr, ptrdiff_t len, T* buf) {
+            typedef typename Key<T>::U U;
+            const int bits = (sizeof(U) == 4)? 11: 8;
+            const int digits = (int)(sizeof(U)*8 + bits - 1) / bits;
+            const U mask = ((U)1 << bits) - 1;
+            C count[digits][1 << bits];
+            memset(count, 0, sizeof(count));
+            for(ptrdiff_t i=0; i<len; ++i) {
+                U k = Key<T>::Get(arr[i]);
+                for(int d=0; d<digits; ++d) ++count[d][(k >> (d*bits)) & mask];
+            }
+            U first = Key<T>::Get(arr[0]);
+            T* src = arr;
+            T* dst = buf;
+            for(int d=0; d<digits; ++d) {
+                int shift = d*bits;
+                if(count[d][(first >> shift) & mask] == len) continue;
+                C sum = 0;
+                for(int i=0; i<=(int)mask; ++i) {
+                    C temp = count[d][i];
+                    count[d][i] = sum;
+                    sum += temp;
+                }
+                ALGO_STAT(moves, len);
+                for(ptrdiff_t i=0; i<len; ++i) dst[count[d][(Key<T>::Get(src[i]) >> shift) & mask]++] = src[i];
+                T* temp = src;
+                src = dst;
+                dst = temp;
+            }
+            if(src != arr) memcpy(arr, src, len * sizeof(T));
+        }
+
+        /**
+        * Sorts array by radix sort, allocates scratch array if buf is not given.
+        */
+        template <typename T>
+        void Run(T* arr, ptrdiff_t len, T* buf) {
+            if(len < 2) return;
+            T* own_buf = (buf == NULL)? new T[len]: NULL;
+            ALGO_STAT(allocations, own_buf? 1: 0);
+            if(len <= INT32_MAX) Sort<T, int>(arr, len, own_buf? own_buf: buf);
+            else Sort<T, ptrdiff_t>(arr, len, own_buf? own_buf: buf);
+            delete[] own_buf;
+        }
+
+    }
+
+    /**
+    * Sorts array using LSD radix-sort algorithm.
+    * Unlike CountSort works for any range of values. Floats are ordered by value,
+    * -0.0 is placed before 0.0 and NaNs with sign bit before all other values, others after them.
+    * T(n) = O(n).
+    * S(n) = O(n), where n is arr size. O(1) if buf is given.
+    *
+    * @param arr array of elements.
+    * @param len length of the array.
+    * @param buf optional scratch array of length at least len, allocated if not given.
+    */
+    inline void ArrRadixSort(int32_t* arr, ptrdiff_t len, int32_t* buf = NULL) { ArrRadix::Run<int32_t>(arr, len, buf); }
+
+    inline void ArrRadixSort(uint32_t* arr, ptrdiff_t len, uint32_t* buf = NULL) { ArrRadix::Run<uint32_t>(arr, len, buf); }
+
+    inline void ArrRadixSort(int64_t* arr, ptrdiff_t len, int64_t* buf = NULL) { ArrRadix::Run<int64_t>(arr, len, buf); }
+
+    inline void ArrRadixSort(uint64_t* arr, ptrdiff_t len, uint64_t* buf = NULL) { ArrRadix::Run<uint64_t>(arr, len, buf); }
+
+    inline void ArrRadixSort(float* arr, ptrdiff_t len, float* buf = NULL) { ArrRadix::Run<float>(arr, len, buf); }
+
+    inline void ArrRadixSort(double* arr, ptrdiff_t len, double* buf = NULL) { ArrRadix::Run<double>(arr, len, buf); }
+
+    // Choosing of sorting algorithm for ArrSort.
+    namespace ArrSortEngine {
+
+        // Sorting algorithms ArrSort can choose from.
+        enum Engine {
+            NONE,       // array is already sorted
+            REVERSE,    // array is sorted in descending order, it is reversed
+            INSERTION,  // ArrInsertionSort
+            COUNT,      // CountSort
+            RADIX,      // ArrRadixSort
+            QUICK       // ArrQuickSort
+        };
+
+        // Arrays of at most this length are sorted by insertion sort.
+        const int INSERTION_LEN = 32;
+
+        // Arrays shorter than this are not worth the radix sort histograms.
+        const int RADIX_MIN_LEN = 512;
+
+        // Number of elements sampled for duplicate density.
+        const int SAMPLE_LEN = 64;
+
+        /**
+        * Description of the input and of the chosen algorithm.
+        *
+        * @param engine chosen sorting algorithm.
+        * @param len length of the array.
+        * @param sorted_prefix length of the longest ascending prefix of the array.
+        * @param range Max(arr) - Min(arr) for integral types CountSort accepts, -1 otherwise.
+        * @param sample_distinct number of distinct values among SAMPLE_LEN sampled elements.
+        */
+        struct Info {
+            Engine engine;
+            ptrdiff_t len;
+            ptrdiff_t sorted_prefix;
+            long long range;
+            int sample_distinct;
+        };
+
+        /**
+        * Returns name of the engine, for logging.
+        */
+        inline const char* Name(Engine engine) {
+            switch(engine) {
+                case NONE: return "none";
+                case REVERSE: return "reverse";
+                case INSERTION: return "insertion";
+                case COUNT: return "count";
+                case RADIX: return "radix";
+                case QUICK: return "quick";
+            }
+            return "unknown";
+        }
+
+        // Value range is known only for types CountSort accepts.
+        template <typename T>
+        inline long long Range(T*, ptrdiff_t) { return -1; }
+
+        inline long long Range(int* arr, ptrdiff_t len) {
+            int min, max;
+            ArrMinMax<int>(arr, len, &min, &max);
+            return (long long)max - min;
+        }
+
+        // Types ArrRadixSort accepts.
+        template <typename T>
+        inline bool HasRadix(T*) { return false; }
+
+        inline bool HasRadix(int32_t*) { return true; }
+        inline bool HasRadix(uint32_t*) { return true; }
+        inline bool HasRadix(int64_t*) { return true; }
+        inline bool HasRadix(uint64_t*) { return true; }
+        inline bool HasRadix(float*) { return true; }
+        inline bool HasRadix(double*) { return true; }
+
+        // Key based engines order by <, they are used only for the default ordering.
+        inline bool IsDefault(Less) { return true; }
+
+        template <typename Compare>
+        inline bool IsDefault(Compare) { return false; }
+
+        // Calls CountSort/ArrRadixSort for types that have it, does nothing otherwise.
+        template <typename T>
+        inline void RunCount(T*, ptrdiff_t) {}
+
+        inline void RunCount(int* arr, ptrdiff_t len) { CountSort(arr, len); }
+
+        template <typename T>
+        inline void RunRadix(T*, ptrdiff_t) {}
+
+        inline void RunRadix(int32_t* arr, ptrdiff_t len) { ArrRadixSort(arr, len); }
+        inline void RunRadix(uint32_t* arr, ptrdiff_t len) { ArrRadixSort(arr, len); }
+        inline void RunRadix(int64_t* arr, ptrdiff_t len) { ArrRadixSort(arr, len); }
+        inline void RunRadix(uint64_t* arr, ptrdiff_t len) { ArrRadixSort(arr, len); }
+        inline void RunRadix(float* arr, ptrdiff_t len) { ArrRadixSort(arr, len); }
+        inline void RunRadix(double* arr, ptrdiff_t len) { ArrRadixSort(arr, len); }
+
+        /**
+        * Counts distinct values among SAMPLE_LEN elements taken with even stride.
+        * Positions of the sample are sorted, so no element is copied.
+        */
+        template <typename T, typename Compare>
+        int SampleDistinct(T* arr, ptrdiff_t len, Compare less) {
+            ptrdiff_t sample[SAMPLE_LEN];
+            int sample_len = (int)Min<ptrdiff_t>(len, SAMPLE_LEN);
+            for(int i=0; i<sample_len; ++i) sample[i] = i * len / sample_len;
+            ArrInsertion::Sort<ptrdiff_t>(sample, sample_len, IndexOrder<T, Compare>(arr, less));
+            int distinct = 1;
+            for(int i=1; i<sample_len; ++i) if(less(arr[sample[i-1]], arr[sample[i]])) ++distinct;
+            return distinct;
+        }
+
+        /**
+        * Inspects the array and chooses the fastest available algorithm.
+        * Sorted and reversed arrays are detected by scanning until the first out of order element,
+        * for integral types in the default ordering the value range is computed, duplicate density is sampled.
+        * T(n) = O(n).
+        * S(n) = O(1).
+        *
+        * @tparam T must be totally ordered and it must have defined >,<,= operators.
+        * @param arr array of elements.
+        * @param len length of the array.
+        * @param less strict weak ordering to sort by.
+        * @return value description of the input and the chosen algorithm.
+        */
+        template <typename T, typename Compare>
+        Info Choose(T* arr, ptrdiff_t len, Compare less) {
+            Info info;
+            info.len = len;
+            info.sorted_prefix = Min<ptrdiff_t>(len, 1);
+            info.range = -1;
+            info.sample_distinct = info.sorted_prefix;
+            if(len < 2) {
+                info.engine = NONE;
+                return info;
+            }
+            while(info.sorted_prefix < len && !less(arr[info.sorted_prefix], arr[info.sorted_prefix-1])) ++info.sorted_prefix;
+            if(info.sorted_prefix == len) {
+                info.engine = NONE;
+                return info;
+            }
+            ptrdiff_t reversed_prefix = 1;
+            while(reversed_prefix < len && !less(arr[reversed_prefix-1], arr[reversed_prefix])) ++reversed_prefix;
+            if(reversed_prefix == len) {
+                info.engine = REVERSE;
+                return info;
+            }
+            info.sample_distinct = SampleDistinct<T>(arr, len, less);
+            if(len <= INSERTION_LEN) {
+                info.engine = INSERTION;
+                return info;
+            }
+            if(!IsDefault(less)) {
+                info.engine = QUICK;
+                return info;
+            }
+            info.range = Range(arr, len);
+            // CountSort is linear while the range is not much larger than the array,
+            // with few distinct values it is cheaper than radix passes even for a larger range
+            if(info.range >= 0 && (info.range <= 2LL*len || (info.sample_distinct <= SAMPLE_LEN/8 && info.range <= 8LL*len))) {
+                info.engine = COUNT;
+            }
+            else if(HasRadix(arr) && len >= RADIX_MIN_LEN) info.engine = RADIX;
+            else info.engine = QUICK;
+            return info;
+        }
+
+        /**
+        * Sorts array by the chosen engine.
+        */
+        template <typename T, typename Compare>
+        void Run(T* arr, ptrdiff_t len, Engine engine, Compare less) {
+            switch(engine) {
+                case NONE:
+                    break;
+                case REVERSE:
+                    for(ptrdiff_t i=0; i<len/2; ++i) ArrSwap<T>(arr, i, len-1-i);
+                    break;
+                case INSERTION:
+                    ArrInsertionSort<T>(arr, len, less);
+                    break;
+                case COUNT:
+                    RunCount(arr, len);
+                    break;
+                case RADIX:
+                    RunRadix(arr, len);
+                    break;
+                case QUICK:
+                    ArrQuickSort<T>(arr, len, less);
+                    break;
+            }
+        }
+
+    }
+
+    /**
+    * Sorts array by the algorithm that suits the input the best.
+    * See ArrSortEngine::Choose for how the algorithm is chosen. Sort is not stable.
+    * T(n) = O(n log(n)), O(n) for sorted or reversed input and for integral or floating types.
+    * S(n) = O(n) for CountSort and ArrRadixSort, O(log(n)) otherwise, where n is arr size.
+    *
+    * @tparam T must be totally ordered and it must have defined >,<,= operators.
+    * @param arr array of elements.
+    * @param len length of the array.
+    * @param info optional, if set, description of the input and of the chosen algorithm will be assigned to it.
+    * @param compare optional strict weak ordering, compare(a, b) is true if a goes before b.
+    *                CountSort and ArrRadixSort are considered only for the default ordering.
+    * @param projection optional, elements are compared by projection(element).
+    */
+    template <typename T, typename Compare = Less, typename Projection = Identity>
+    void ArrSort(T* arr, ptrdiff_t len, ArrSortEngine::Info* info = NULL,
+                 Compare compare = Compare(), Projection projection = Projection()) {
+        ArrSortEngine::Info chosen = ArrSortEngine::Choose<T>(arr, len, MakeOrder(compare, projection));
+        ArrSortEngine::Run<T>(arr, len, chosen.engine, MakeOrder(compare, projection));
+        if(info) *info = chosen;
+    }
+
+    // Operations used by binary searches.
+    namespace ArrSearch {
+
+        /**
+        * True for elements whose projection goes before target, lower bound is the first element it is false for.
+        */
+        template <typename K, typename Compare, typename Projection>
+        struct Before {
+            const K& target;
+            Compare compare;
+            Projection projection;
+            Before(const K& t, Compare c, Projection p): target(t), compare(c), projection(p) {}
+            template <typename T>
+            bool operator()(const T& x) const { return compare(projection(x), target); }
+        };
+
+        /**
+        * True for elements whose projection does not go after target, upper bound is the first element it is false for.
+        */
+        template <typename K, typename Compare, typename Projection>
+        struct NotAfter {
+            const K& target;
+            Compare compare;
+            Projection projection;
+            NotAfter(const K& t, Compare c, Projection p): target(t), compare(c), projection(p) {}
+            template <typename T>
+            bool operator()(const T& x) const { return !compare(target, projection(x)); }
+        };
+
+        /**
+        * Finds the first element pred is false for, pred must be true for a prefix of the array.
+        * The loop has a fixed number of iterations for given len and the next position is chosen by
+        * arithmetic instead of a branch, so there are no mispredictions. Both possible next probes are prefetched.
+        * T(n) = O(log(n)).
+        * S(n) = O(1).
+        */
+        template <typename T, typename Predicate>
+        ptrdiff_t PartitionPoint(T* arr, ptrdiff_t len, Predicate pred) {
+            T* base = arr;
+            ptrdiff_t n = len;
+            while(n > 1) {
+                ptrdiff_t half = n/2;
+                ALGO_PREFETCH(base + (n-half)/2 - 1);
+                ALGO_PREFETCH(base + half + (n-half)/2 - 1);
+                base += pred(base[half-1]) * half;
+                n -= half;
+            }
+            return (base - arr) + (n == 1 && pred(*base));
+        }
+
+        // Number of searches advanced in lock-step by batched search.
+        const int BATCH_SIZE = 32;
+
+        /**
+        * Lower bounds of up to BATCH_SIZE queries, searched in lock-step.
+        * All searches take the same number of steps, after each step the next probes of all of them
+        * are prefetched before any is compared, so their cache misses overlap.
+        */
+        template <typename T, typename K, typename Index, typename Compare, typename Projection>
+        void LowerBoundBatch(T* arr, ptrdiff_t len, K* queries, int nq, Index* positions, Compare compare, Projection projection) {
+            T* base[BATCH_SIZE];
+            for(int j=0; j<nq; ++j) base[j] = arr;
+            ptrdiff_t n = len;
+            while(n > 1) {
+                ptrdiff_t half = n/2;
+                for(int j=0; j<nq; ++j) base[j] += compare(projection(base[j][half-1]), queries[j]) * half;
+                n -= half;
+                for(int j=0; j<nq; ++j) ALGO_PREFETCH(base[j] + n/2 - 1);
+            }
+            for(int j=0; j<nq; ++j) positions[j] = (Index)((base[j] - arr) + (n == 1 && compare(projection(*base[j]), queries[j])));
+        }
+
+        /**
+        * Lower bounds of sorted queries, each is searched from the previous one by galloping
+        * (exponential steps, then binary search in the last step). Close queries cost O(1), the whole
+        * batch O(nq log(len / nq)), so it is never worse than a linear merge or separate searches.
+        */
+        template <typename T, typename K, typename Index, typename Compare, typename Projection>
+        void LowerBoundGallop(T* arr, ptrdiff_t len, K* queries, ptrdiff_t nq, Index* positions, Compare compare, Projection projection) {
+            ptrdiff_t lo = 0;
+            for(ptrdiff_t i=0; i<nq; ++i) {
+                Before<K, Compare, Projection> before(queries[i], compare, projection);
+                ptrdiff_t bound = 1;
+                while(lo + bound <= len && before(arr[lo+bound-1])) {
+                    lo += bound;
+                    bound *= 2;
+                }
+                lo += PartitionPoint(arr+lo, Min<ptrdiff_t>(bound-1, len-lo), before);
+                positions[i] = (Index)lo;
+            }
+        }
+
+    }
+
+    /**
+    * Finds the first element of sorted array that does not go before target.
+    * Iterative and branchless, see ArrSearch::PartitionPoint.
+    * T(n) = O(log(n)).
+    * S(n) = O(1).
+    *
+    * @tparam T must be totally ordered and it must have defined >,<,= operators.
+    * @tparam K type of the searched key, T if no projection is given.
+    * @param arr array of elements, must be sorted by compare and projection.
+    * @param len length of the array.
+    * @param target searched key.
+    * @param compare optional strict weak ordering, compare(a, b) is true if a goes before b.
+    * @param projection optional, projection(element) is compared to target.
+    * @return index of the first element not going before target, len if there is none.
+    */
+    template <typename T, typename K = T, typename Compare = Less, typename Projection = Identity>
+    ptrdiff_t LowerBound(T* arr, ptrdiff_t len, const K& target, Compare compare = Compare(), Projection projection = Projection()) {
+        return ArrSearch::PartitionPoint(arr, len, ArrSearch::Before<K, Compare, Projection>(target, compare, projection));
+    }
+
+    /**
+    * Finds the first element of sorted array that goes after target.
+    * Iterative and branchless, see ArrSearch::PartitionPoint.
+    * T(n) = O(log(n)).
+    * S(n) = O(1).
+    *
+    * @tparam T must be totally ordered and it must have defined >,<,= operators.
+    * @tparam K type of the searched key, T if no projection is given.
+    * @param arr array of elements, must be sorted by compare and projection.
+    * @param len length of the array.
+    * @param target searched key.
+    * @param compare optional strict weak ordering, compare(a, b) is true if a goes before b.
+    * @param projection optional, projection(element) is compared to target.
+    * @return index of the first element going after target, len if there is none.
+    */
+    template <typename T, typename K = T, typename Compare = Less, typename Projection = Identity>
+    ptrdiff_t UpperBound(T* arr, ptrdiff_t len, const K& target, Compare compare = Compare(), Projection projection = Projection()) {
+        return ArrSearch::PartitionPoint(arr, len, ArrSearch::NotAfter<K, Compare, Projection>(target, compare, projection));
+    }
+
+    /**
+    * Finds the range of elements of sorted array equal to target, [beg, end).
+    * The upper bound is searched only in the part after the lower bound.
+    * T(n) = O(log(n)).
+    * S(n) = O(1).
+    *
+    * @tparam T must be totally ordered and it must have defined >,<,= operators.
+    * @tparam K type of the searched key, T if no projection is given.
+    * @param arr array of elements, must be sorted by compare and projection.
+    * @param len length of the array.
+    * @param target searched key.
+    * @param beg index of the first equal element will be assigned to it.
+    * @param end index after the last equal element will be assigned to it, beg == end if there is none.
+    * @param compare optional strict weak ordering, compare(a, b) is true if a goes before b.
+    * @param projection optional, projection(element) is compared to target.
+    */
+    template <typename T, typename K = T, typename Compare = Less, typename Projection = Identity>
+    void EqualRange(T* arr, ptrdiff_t len, const K& target, ptrdiff_t* beg, ptrdiff_t* end, Compare compare = Compare(), Projection projection = Projection()) {
+        *beg = LowerBound<T, K>(arr, len, target, compare, projection);
+        *end = *beg + UpperBound<T, K>(arr + *beg, len - *beg, target, compare, projection);
+    }
+
+    /**
+    * Finds lower bounds of many keys in sorted array, positions[i] = LowerBound(arr, len, queries[i]).
+    * Unsorted queries are searched in groups of ArrSearch::BATCH_SIZE advanced in lock-step, so the cache
+    * misses of a group overlap. If the queries are sorted, each is found by galloping from the previous one.
+    * T(n) = O(q log(n)), O(q log(n / q)) for sorted queries, where q is the number of queries.
+    * S(n) = O(1).
+    *
+    * @tparam T must be totally ordered and it must have defined >,<,= operators.
+    * @tparam K type of the searched keys, T if no projection is given.
+    * @param arr array of elements, must be sorted by compare and projection.
+    * @param len length of the array.
+    * @param queries searched keys.
+    * @param nq number of queries.
+    * @param positions array of length nq, lower bounds will be assigned to it, of any integral type
+    *                  that holds len (int positions take half the memory of ptrdiff_t ones).
+    * @param compare optional strict weak ordering, compare(a, b) is true if a goes before b.
+    * @param projection optional, projection(element) is compared to queries.
+    */
+    template <typename T, typename K = T, typename Compare = Less, typename Projection = Identity, typename Index>
+    void BinarySearchBatch(T* arr, ptrdiff_t len, K* queries, ptrdiff_t nq, Index* positions,
+                           Compare compare = Compare(), Projection projection = Projection()) {
+        bool sorted = true;
+        for(ptrdiff_t i=1; i<nq && sorted; ++i) sorted = !compare(queries[i], queries[i-1]);
+        if(sorted) {
+            ArrSearch::LowerBoundGallop(arr, len, queries, nq, positions, compare, projection);
+            return;
+        }
+        for(ptrdiff_t i=0; i<nq; i+=ArrSearch::BATCH_SIZE) {
+            int group = (int)Min<ptrdiff_t>(ArrSearch::BATCH_SIZE, nq-i);
+            ArrSearch::LowerBoundBatch(arr, len, queries+i, group, positions+i, compare, projection);
+        }
+    }
+
+    /**
+    * Find if element is in sorted array, between two indexes. 
+    * Iterative, uses LowerBound.
+    * T(n) = O(log(n)).
+    * S(n) = O(1).
+    *
+    * @tparam T must be totally ordered and it must have defined >,<,= operators.
+    * @tparam K type of the searched key, T if no projection is given.
+    * @param arr array of elements, must be sorted by compare and projection.
+    * @param target element that is being searched for.
+    * @param beg starting index.
+    * @param beg ending index index.
+    * @param compare optional strict weak ordering, compare(a, b) is true if a goes before b.
+    * @param projection optional, projection(element) is compared to target.
+    *
+    * @return value returns True if target is in array, false otherwise 
+    */
+    template <typename T, typename K = T, typename Compare = Less, typename Projection = Identity>
+    bool BinarySearch(T* arr, K target, ptrdiff_t beg, ptrdiff_t end, Compare compare = Compare(), Projection projection = Projection()) {
+        if(end < beg) return false;
+        ptrdiff_t i = beg + LowerBound<T, K>(arr+beg, end-beg+1, target, compare, projection);
+        return i <= end && !compare(target, projection(arr[i]));
+    };
+
+    /**
+    * Static search index over sorted array in Eytzinger (BFS) layout.
+    * Node k has children 2k and 2k+1, so the first levels of the tree share few cache lines and the
+    * descendants of a node four levels down are one cache line, which is prefetched while the node is compared.
+    * The search loop is branchless. Faster than LowerBound for large arrays searched many times.
+    * T(n) = O(n) to build, O(log(n)) to search.
+    * S(n) = O(n).
+    *
+    * @tparam T must be totally ordered and it must have defined >,<,= operators.
+    * @tparam Compare strict weak ordering, compare(a, b) is true if a goes before b.
+    * @tparam Projection elements are compared by projection(element).
+    */
+    template <typename T, typename Compare = Less, typename Projection = Identity>
+    class EytzingerIndex {
+        public:
+            /**
+            * Builds index of sorted array, arr is copied and can be freed.
+            *
+            * @param arr array of elements, must be sorted by compare and projection.
+            * @param len length of the array.
+            */
+            EytzingerIndex(T* arr, ptrdiff_t len, Compare compare = Compare(), Projection projection = Projection())
+                : length(len), compare(compare), projection(projection) {
+                // tree starts a cache line, so descendants k*PREFETCH_STRIDE, ... of node k share one,
+                // its elements are constructed in raw memory, slot 0 is never constructed
+                storage = new char[(len + 1) * sizeof(T) + 64];
+                tree = (T*)(storage + (64 - ((uintptr_t)storage) % 64) % 64);
+                rank = new ptrdiff_t[len + 1];
+                rank[0] = len;
+                ptrdiff_t i = 0;
+                Fill(arr, &i, 1);
+            }
+
+            ~EytzingerIndex() {
+                for(ptrdiff_t k=1; k<=length; ++k) tree[k].~T();
+                delete[] storage;
+                delete[] rank;
+            }
+
+            /**
+            * Finds the first element that does not go before target.
+            * T(n) = O(log(n)).
+            * S(n) = O(1).
+            *
+            * @param target searched key.
+            * @return index of the element in the original sorted array, Length() if there is none.
+            */
+            template <typename K>
+            ptrdiff_t LowerBound(const K& target) { return rank[Find(target)]; }
+
+            /**
+            * Finds if an element equal to target is in the index.
+            * T(n) = O(log(n)).
+            * S(n) = O(1).
+            */
+            template <typename K>
+            bool Contains(const K& target) {
+                ptrdiff_t k = Find(target);
+                return k != 0 && !compare(target, projection(tree[k]));
+            }
+
+            /**
+            * Returns number of indexed elements.
+            */
+            ptrdiff_t Length() { return length; }
+
+        private:
+            // Elements per prefetched cache line, descendants this many times deeper are prefetched.
+            static const int PREFETCH_STRIDE = (64 % sizeof(T) == 0 && sizeof(T) <= 16)? (int)(64 / sizeof(T)): 4;
+
+            ptrdiff_t length;
+            Compare compare;
+            Projection projection;
+            char* storage;
+            T* tree;
+            ptrdiff_t* rank;
+
+            EytzingerIndex(const EytzingerIndex&);
+            EytzingerIndex& operator=(const EytzingerIndex&);
+
+            /**
+            * Assigns elements of arr from *i to the subtree of node k by in-order traversal.
+            */
+            void Fill(T* arr, ptrdiff_t* i, ptrdiff_t k) {
+                if(k > length) return;
+                Fill(arr, i, 2*k);
+                new(&tree[k]) T(arr[*i]);
+                rank[k] = (*i)++;
+                Fill(arr, i, 2*k+1);
+            }
+
+            /**
+            * Returns node of the first element that does not go before target, 0 if there is none.
+            */
+            template <typename K>
+            ptrdiff_t Find(const K& target) {
+                ptrdiff_t k = 1;
+                while(k <= length) {
+                    ALGO_PREFETCH(tree + (long long)k * PREFETCH_STRIDE);
+                    k = 2*k + compare(projection(tree[k]), target);
+                }
+                // the path went right since the answer, drop those steps and the last left one
+#if defined(__GNUC__)
+                return k >> __builtin_ffsll(~(long long)k);
+#else
+                while(k & 1) k >>= 1;
+                return k >> 1;
+#endif
+            }
+    };
+
+    // Operations used by interpolation search and learned index.
+    namespace ArrInterpolation {
+
+        // Interpolation search makes at most this many probes, then it finishes by LowerBound.
+        const int MAX_PROBES = 8;
+
+        // Parts at most this long are finished by LowerBound.
+        const int MIN_LEN = 32;
+
+        /**
+        * Returns a - b as double, a >= b. 64-bit integers are subtracted exactly first, so keys
+        * larger than 2^53 keep their differences.
+        */
+        template <typename T>
+        inline double Diff(T a, T b) { return (double)a - (double)b; }
+
+        inline double Diff(int32_t a, int32_t b) { return (double)((int64_t)a - b); }
+        inline double Diff(uint32_t a, uint32_t b) { return (double)(a - b); }
+        inline double Diff(int64_t a, int64_t b) { return (double)((uint64_t)a - (uint64_t)b); }
+        inline double Diff(uint64_t a, uint64_t b) { return (double)(a - b); }
+
+    }
+
+    /**
+    * Finds the first element of sorted numeric array that is not smaller than target, by interpolation search.
+    * Position of target is estimated from the values at both ends of the searched part, which needs
+    * O(log(log(n))) probes for evenly distributed keys. After ArrInterpolation::MAX_PROBES probes or for
+    * a short part the search finishes by LowerBound, so it never takes more than O(log(n)).
+    * T(n) = O(log(log(n))) for evenly distributed keys, O(log(n)) worst case.
+    * S(n) = O(1).
+    *
+    * @tparam T numeric type, integral or floating (without NaN).
+    * @param arr sorted array of elements.
+    * @param len length of the array.
+    * @param target searched key.
+    * @return index of the first element not smaller than target, len if there is none.
+    */
+    template <typename T>
+    ptrdiff_t InterpolationSearch(T* arr, ptrdiff_t len, T target) {
+        ptrdiff_t lo = 0;
+        ptrdiff_t hi = len;
+        for(int probes=0; probes<ArrInterpolation::MAX_PROBES && hi - lo > ArrInterpolation::MIN_LEN; ++probes) {
+            if(!(arr[lo] < target)) return lo;
+            if(arr[hi-1] < target) return hi;
+            double frac = ArrInterpolation::Diff(target, arr[lo]) / ArrInterpolation::Diff(arr[hi-1], arr[lo]);
+            ptrdiff_t mid = lo + (ptrdiff_t)(frac * (hi-1-lo));
+            if(arr[mid] < target) lo = mid+1;
+            else hi = mid;
+        }
+        return lo + LowerBound<T>(arr+lo, hi-lo, target);
+    }
+
+    /**
+    * Read-only learned index over sorted numeric array, in the spirit of PGM index.
+    * Keys are covered by linear segments, each predicting positions of its keys with error at most eps.
+    * Segments are built in one pass by shrinking the cone of slopes that keep all keys within the error
+    * and are found by branchless binary search over their first keys, which is a small array.
+    * The position is then found by LowerBound in 2*eps + 3 elements around the prediction; if the answer
+    * is outside (a missing key after a long run of duplicates), the window is extended by galloping.
+    * The array is not copied, it must live as long as the index.
+    * T(n) = O(n) to build, O(log(s) + log(eps)) to search, where s is the number of segments.
+    * S(n) = O(s).
+    *
+    * @tparam T numeric type, integral or floating (without NaN).
+    */
+    template <typename T>
+    class LearnedIndex {
+        public:
+            /**
+            * Builds index of sorted array.
+            *
+            * @param arr sorted array of elements.
+            * @param len length of the array.
+            * @param eps maximal error of predicted positions, smaller gives more segments and shorter final search.
+            */
+            LearnedIndex(T* arr, ptrdiff_t len, int eps = 16): arr(arr), length(len), eps(Max<int>(eps, 1)), segments(0) {
+                ptrdiff_t cap = 16;
+                keys = new T[cap];
+                segs = new Segment[cap];
+                double lo = 0;
+                double hi = 0;
+                ptrdiff_t points = 0;
+                for(ptrdiff_t i=0; i<len; ++i) {
+                    // duplicates are predicted at their first position
+                    if(i > 0 && !(arr[i-1] < arr[i])) continue;
+                    if(points > 0) {
+                        // slopes that keep key i within eps of its position
+                        double dx = ArrInterpolation::Diff(arr[i], keys[segments-1]);
+                        double dy = i - segs[segments-1].start;
+                        double new_lo = (dy - this->eps) / dx;
+                        double new_hi = (dy + this->eps) / dx;
+                        if(points == 1 || (new_lo <= hi && new_hi >= lo)) {
+                            lo = (points == 1)? new_lo: Max<double>(lo, new_lo);
+                            hi = (points == 1)? new_hi: Min<double>(hi, new_hi);
+                            ++points;
+                            continue;
+                        }
+                        segs[segments-1].slope = Max<double>((lo + hi) / 2, 0);
+                        segs[segments-1].end = i;
+                    }
+                    if(segments == cap) Grow(&cap);
+                    keys[segments] = arr[i];
+                    segs[segments].start = i;
+                    ++segments;
+                    points = 1;
+                }
+                if(segments > 0) {
+                    segs[segments-1].slope = (points == 1)? 0: Max<double>((lo + hi) / 2, 0);
+                    segs[segments-1].end = len;
+                }
+            }
+
+            ~LearnedIndex() {
+                delete[] keys;
+                delete[] segs;
+            }
+
+            /**
+            * Finds the first element that is not smaller than target.
+            * T(n) = O(log(s) + log(eps)).
+            * S(n) = O(1).
+            *
+            * @param target searched key.
+            * @return index of the element in the array, Length() if there is none.
+            */
+            ptrdiff_t LowerBound(T target) {
+                ptrdiff_t s = UpperBound<T>(keys, segments, target) - 1;
+                if(s < 0) return 0;
+                const Segment& seg = segs[s];
+                double offset = seg.slope * ArrInterpolation::Diff(target, keys[s]);
+                ptrdiff_t pred = seg.start + (ptrdiff_t)Min<double>(offset, (double)(seg.end - seg.start));
+                ptrdiff_t beg = Max<ptrdiff_t>(0, pred - eps - 1);
+                ptrdiff_t end = Min<ptrdiff_t>(length, pred + eps + 2);
+                ptrdiff_t step = eps + 1;
+                if(beg > 0 && !(arr[beg-1] < target)) {
+                    // answer is before the window
+                    while(beg > 0 && !(arr[beg-1] < target)) {
+                        end = beg;
+                        beg = Max<ptrdiff_t>(0, beg - step);
+                        step *= 2;
+                    }
+                }
+                else {
+                    // answer is after the window
+                    while(end < length && arr[end-1] < target) {
+                        beg = end;
+                        end = Min<ptrdiff_t>(length, end + step);
+                        step *= 2;
+                    }
+                }
+                return beg + algo::LowerBound<T>(arr+beg, end-beg, target);
+            }
+
+            /**
+            * Finds if target is in the array.
+            * T(n) = O(log(s) + log(eps)).
+            * S(n) = O(1).
+            */
+            bool Contains(T target) {
+                ptrdiff_t i = LowerBound(target);
+                return i < length && !(target < arr[i]);
+            }
+
+            /**
+            * Returns number of segments.
+            */
+            ptrdiff_t Segments() { return segments; }
+
+            /**
+            * Returns size of the index in bytes, without the array.
+            */
+            long long Bytes() { return (long long)segments * (sizeof(T) + sizeof(Segment)); }
+
+        private:
+            /**
+            * Linear model of one segment, key k is predicted at start + slope * (k - first key).
+            * Keys are kept in a separate array, so the searched array is dense.
+            */
+            struct Segment {
+                double slope;
+                ptrdiff_t start;
+                ptrdiff_t end;
+            };
+
+            T* arr;
+            ptrdiff_t length;
+            int eps;
+            ptrdiff_t segments;
+            T* keys;
+            Segment* segs;
+
+            LearnedIndex(const LearnedIndex&);
+            LearnedIndex& operator=(const LearnedIndex&);
+
+            /**
+            * Doubles capacity of the segment arrays.
+            */
+            void Grow(ptrdiff_t* cap) {
+                T* new_keys = new T[2 * *cap];
+                Segment* new_segs = new Segment[2 * *cap];
+                for(ptrdiff_t i=0; i<segments; ++i) {
+                    new_keys[i] = keys[i];
+                    new_segs[i] = segs[i];
+                }
+                delete[] keys;
+                delete[] segs;
+                keys = new_keys;
+                segs = new_segs;
+                *cap *= 2;
+            }
+    };
+
+    // Operations used by set operations on sorted arrays.
+    namespace ArrSet {
+
+        // Arrays more than this many times longer than the other one are searched by galloping.
+        const int GALLOP_RATIO = 32;
+
+        /**
+        * Finds the first element of arr[from, len) that does not go before key, by exponential steps from
+        * from and binary search in the last step, so close keys cost O(1).
+        */
+        template <typename T, typename Compare>
+        ptrdiff_t Gallop(T* arr, ptrdiff_t from, ptrdiff_t len, const T& key, Compare less) {
+            ptrdiff_t bound = 1;
+            while(from + bound <= len && less(arr[from+bound-1], key)) {
+                from += bound;
+                bound *= 2;
+            }
+            ptrdiff_t to = Min<ptrdiff_t>(from + bound - 1, len);
+            while(from < to) {
+                ptrdiff_t mid = from + (to - from) / 2;
+                if(less(arr[mid], key)) from = mid + 1;
+                else to = mid;
+            }
+            return from;
+        }
+
+        /**
+        * Intersection by merging, only counts elements if out is NULL.
+        */
+        template <typename T, typename Compare>
+        ptrdiff_t IntersectMerge(T* a, ptrdiff_t a_len, T* b, ptrdiff_t b_len, T* out, Compare less) {
+            ptrdiff_t i = 0, j = 0, n = 0;
+            while(i < a_len && j < b_len) {
+                if(less(a[i], b[j])) ++i;
+                else if(less(b[j], a[i])) ++j;
+                else {
+                    if(out) out[n] = a[i];
+                    ++n;
+                    ++i;
+                    ++j;
+                }
+            }
+            return n;
+        }
+
+        /**
+        * Intersection of short array small and long array large, each element of small is found by Gallop.
+        * Elements of a are written, small_is_a tells which one it is.
+        */
+        template <typename T, typename Compare>
+        ptrdiff_t IntersectGallop(T* small, ptrdiff_t s_len, T* large, ptrdiff_t l_len, T* out, bool small_is_a, Compare less) {
+            ptrdiff_t j = 0, n = 0;
+            for(ptrdiff_t i=0; i<s_len; ++i) {
+                j = Gallop<T>(large, j, l_len, small[i], less);
+                if(j == l_len) break;
+                if(!less(small[i], large[j])) {
+                    if(out) out[n] = small_is_a? small[i]: large[j];
+                    ++n;
+                    ++j;
+                }
+            }
+            return n;
+        }
+
+        /**
+        * Intersection of arrays of similar lengths, vectorized for int32_t in the default order.
+        */
+        template <typename T, typename Compare>
+        ptrdiff_t IntersectSimilar(T* a, ptrdiff_t a_len, T* b, ptrdiff_t b_len, T* out, Compare less) {
+            return IntersectMerge<T>(a, a_len, b, b_len, out, less);
+        }
+
+        template <typename T, typename Compare>
+        ptrdiff_t Intersect(T* a, ptrdiff_t a_len, T* b, ptrdiff_t b_len, T* out, Compare less) {
+            if(a_len == 0 || b_len == 0) return 0;
+            if(a_len < b_len / GALLOP_RATIO) return IntersectGallop<T>(a, a_len, b, b_len, out, true, less);
+            if(b_len < a_len / GALLOP_RATIO) return IntersectGallop<T>(b, b_len, a, a_len, out, false, less);
+            return IntersectSimilar<T>(a, a_len, b, b_len, out, less);
+        }
+
+        /**
+        * Union of short array small and long array large, runs of large between elements of small are
+        * found by Gallop and copied. Of equal elements the one of a is written, small_is_a tells which one it is.
+        */
+        template <typename T, typename Compare>
+        ptrdiff_t UnionGallop(T* small, ptrdiff_t s_len, T* large, ptrdiff_t l_len, T* out, bool small_is_a, Compare less) {
+            ptrdiff_t j = 0, n = 0;
+            for(ptrdiff_t i=0; i<s_len; ++i) {
+                ptrdiff_t next = Gallop<T>(large, j, l_len, small[i], less);
+                for(; j<next; ++j) out[n++] = large[j];
+                bool equal = j < l_len && !less(small[i], large[j]);
+                out[n++] = (equal && !small_is_a)? large[j]: small[i];
+                if(equal) ++j;
+            }
+            for(; j<l_len; ++j) out[n++] = large[j];
+            return n;
+        }
+
+        template <typename T, typename Compare>
+        ptrdiff_t Union(T* a, ptrdiff_t a_len, T* b, ptrdiff_t b_len, T* out, Compare less) {
+            if(a_len < b_len / GALLOP_RATIO) return UnionGallop<T>(a, a_len, b, b_len, out, true, less);
+            if(b_len < a_len / GALLOP_RATIO) return UnionGallop<T>(b, b_len, a, a_len, out, false, less);
+            ptrdiff_t i = 0, j = 0, n = 0;
+            while(i < a_len && j < b_len) {
+                if(less(a[i], b[j])) out[n++] = a[i++];
+                else if(less(b[j], a[i])) out[n++] = b[j++];
+                else {
+                    out[n++] = a[i++];
+                    ++j;
+                }
+            }
+            for(; i<a_len; ++i) out[n++] = a[i];
+            for(; j<b_len; ++j) out[n++] = b[j];
+            return n;
+        }
+
+        /**
+        * Difference a \ b by merging.
+        */
+        template <typename T, typename Compare>
+        ptrdiff_t DifferenceMerge(T* a, ptrdiff_t a_len, T* b, ptrdiff_t b_len, T* out, Compare less) {
+            ptrdiff_t i = 0, j = 0, n = 0;
+            while(i < a_len && j < b_len) {
+                if(less(a[i], b[j])) out[n++] = a[i++];
+                else if(less(b[j], a[i])) ++j;
+                else {
+                    ++i;
+                    ++j;
+                }
+            }
+            for(; i<a_len; ++i) out[n++] = a[i];
+            return n;
+        }
+
+        /**
+        * Difference of arrays of similar lengths, vectorized for int32_t in the default order.
+        */
+        template <typename T, typename Compare>
+        ptrdiff_t DifferenceSimilar(T* a, ptrdiff_t a_len, T* b, ptrdiff_t b_len, T* out, Compare less) {
+            return DifferenceMerge<T>(a, a_len, b, b_len, out, less);
+        }
+
+        template <typename T, typename Compare>
+        ptrdiff_t Difference(T* a, ptrdiff_t a_len, T* b, ptrdiff_t b_len, T* out, Compare less) {
+            ptrdiff_t i = 0, j = 0, n = 0;
+            // each element of short a is looked up in b
+            if(a_len < b_len / GALLOP_RATIO) {
+                for(; i<a_len; ++i) {
+                    j = Gallop<T>(b, j, b_len, a[i], less);
+                    if(j == b_len || less(a[i], b[j])) out[n++] = a[i];
+                }
+                return n;
+            }
+            // runs of a between elements of short b are copied
+            if(b_len < a_len / GALLOP_RATIO) {
+                for(; j<b_len; ++j) {
+                    ptrdiff_t next = Gallop<T>(a, i, a_len, b[j], less);
+                    for(; i<next; ++i) out[n++] = a[i];
+                    if(i < a_len && !less(b[j], a[i])) ++i;
+                }
+                for(; i<a_len; ++i) out[n++] = a[i];
+                return n;
+            }
+            return DifferenceSimilar<T>(a, a_len, b, b_len, out, less);
+        }
+
+    }
+
+#ifdef ALGO_SIMD
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpsabi"
+
+    namespace ArrSimd {
+
+        /**
+        * Marks lanes of a that are equal to some lane of b in found, by comparing a with all rotations of b.
+        */
+        inline __attribute__((always_inline)) void Found(const I32x8& a, const I32x8& v, I32x8& found) {
+            const int L = Vec<int32_t>::L;
+            I32x8 b = v;
+            I32x8 lanes;
+            Vec<int32_t>::Lanes(lanes);
+            I32x8 rotate = (lanes + 1) & (L-1);
+            found |= (a == b);
+            for(int r=1; r<L; ++r) {
+                b = __builtin_shuffle(b, rotate);
+                found |= (a == b);
+            }
+        }
+
+        /**
+        * Intersection of sorted sets of int32_t by blocks of L elements. The current blocks are compared
+        * by Found, then the block with the smaller last element (or both) is replaced by the next one.
+        * Elements of a found in b are packed into a small buffer and copied to out, or only counted if COUNT.
+        * Stops when an array has less than L elements left, *a_end and *b_end are where scalar code continues.
+        */
+        template <bool COUNT>
+        inline __attribute__((always_inline)) ptrdiff_t IntersectBlocks(const int32_t* a, ptrdiff_t a_len, const int32_t* b, ptrdiff_t b_len,
+                                                                       int32_t* out, ptrdiff_t* a_end, ptrdiff_t* b_end) {
+            typedef Vec<int32_t>::V V;
+            const int L = Vec<int32_t>::L;
+            ptrdiff_t i = 0, j = 0, n = 0;
+            while(i + L <= a_len && j + L <= b_len) {
+                V va;
+                V vb;
+                memcpy(&va, a+i, sizeof(V));
+                memcpy(&vb, b+j, sizeof(V));
+                I32x8 found = {0, 0, 0, 0, 0, 0, 0, 0};
+                Found(va, vb, found);
+                if(COUNT) {
+                    for(int k=0; k<L; ++k) n -= found[k];
+                }
+                else {
+                    int32_t kept[L];
+                    int m = 0;
+                    for(int k=0; k<L; ++k) {
+                        kept[m] = va[k];
+                        m -= found[k];
+                    }
+                    memcpy(out+n, kept, m * sizeof(int32_t));
+                    n += m;
+                }
+                int32_t a_max = a[i+L-1];
+                int32_t b_max = b[j+L-1];
+                if(a_max <= b_max) i += L;
+                if(b_max <= a_max) j += L;
+            }
+            *a_end = i;
+            *b_end = j;
+            return n;
+        }
+
+        /**
+        * Difference a \ b of sorted sets of int32_t by blocks like IntersectBlocks. Matches of the current block
+        * of a are collected over the blocks of b it is compared with, its other elements are written when it
+        * is replaced. Scalar code continues from *b_end, the first block of b compared with the unfinished block of a.
+        */
+        inline __attribute__((always_inline)) ptrdiff_t DifferenceBlocks(const int32_t* a, ptrdiff_t a_len, const int32_t* b, ptrdiff_t b_len,
+                                                                        int32_t* out, ptrdiff_t* a_end, ptrdiff_t* b_end) {
+            typedef Vec<int32_t>::V V;
+            const int L = Vec<int32_t>::L;
+            ptrdiff_t i = 0, j = 0, j_first = 0, n = 0;
+            I32x8 found = {0, 0, 0, 0, 0, 0, 0, 0};
+            while(i + L <= a_len && j + L <= b_len) {
+                V va;
+                V vb;
+                memcpy(&va, a+i, sizeof(V));
+                memcpy(&vb, b+j, sizeof(V));
+                Found(va, vb, found);
+                int32_t a_max = a[i+L-1];
+                int32_t b_max = b[j+L-1];
+                if(b_max <= a_max) j += L;
+                if(a_max <= b_max) {
+                    int32_t kept[L];
+                    int m = 0;
+                    for(int k=0; k<L; ++k) {
+                        kept[m] = va[k];
+                        m += 1 + found[k];
+                    }
+                    memcpy(out+n, kept, m * sizeof(int32_t));
+                    n += m;
+                    found ^= found;
+                    i += L;
+                    j_first = j;
+                }
+            }
+            *a_end = i;
+            *b_end = j_first;
+            return n;
+        }
+
+        __attribute__((target_clones("avx2", "sse4.2", "default")))
+        inline ptrdiff_t IntersectInt32(const int32_t* a, ptrdiff_t a_len, const int32_t* b, ptrdiff_t b_len, int32_t* out, ptrdiff_t* a_end, ptrdiff_t* b_end) {
+            return IntersectBlocks<false>(a, a_len, b, b_len, out, a_end, b_end);
+        }
+
+        __attribute__((target_clones("avx2", "sse4.2", "default")))
+        inline ptrdiff_t IntersectCountInt32(const int32_t* a, ptrdiff_t a_len, const int32_t* b, ptrdiff_t b_len, ptrdiff_t* a_end, ptrdiff_t* b_end) {
+            return IntersectBlocks<true>(a, a_len, b, b_len, NULL, a_end, b_end);
+        }
+
+        __attribute__((target_clones("avx2", "sse4.2", "default")))
+        inline ptrdiff_t DifferenceInt32(const int32_t* a, ptrdiff_t a_len, const int32_t* b, ptrdiff_t b_len, int32_t* out, ptrdiff_t* a_end, ptrdiff_t* b_end) {
+            return DifferenceBlocks(a, a_len, b, b_len, out, a_end, b_end);
+        }
+
+    }
+
+    namespace ArrSet {
+
+        template <>
+        inline ptrdiff_t IntersectSimilar<int32_t, Less>(int32_t* a, ptrdiff_t a_len, int32_t* b, ptrdiff_t b_len, int32_t* out, Less less) {
+            ptrdiff_t i, j;
+            ptrdiff_t n = out? ArrSimd::IntersectInt32(a, a_len, b, b_len, out, &i, &j): ArrSimd::IntersectCountInt32(a, a_len, b, b_len, &i, &j);
+            return n + IntersectMerge<int32_t>(a+i, a_len-i, b+j, b_len-j, out? out+n: NULL, less);
+        }
+
+        template <>
+        inline ptrdiff_t DifferenceSimilar<int32_t, Less>(int32_t* a, ptrdiff_t a_len, int32_t* b, ptrdiff_t b_len, int32_t* out, Less less) {
+            ptrdiff_t i, j;
+            ptrdiff_t n = ArrSimd::DifferenceInt32(a, a_len, b, b_len, out, &i, &j);
+            return n + DifferenceMerge<int32_t>(a+i, a_len-i, b+j, b_len-j, out+n, less);
+        }
+
+    }
+
+#pragma GCC diagnostic pop
+#endif
+
+    /**
+    * Intersection of sorted sets, writes elements of a that are also in b to out.
+    * Arrays of similar lengths are merged, int32_t arrays in the default order compare blocks of 8 elements
+    * by vector shuffles. If one array is more than ArrSet::GALLOP_RATIO times longer, the elements of the
+    * shorter one are searched in it by galloping.
+    * T(n, m) = O(n + m), O(n log(m / n)) for n much smaller than m.
+    * S(n, m) = O(1), where n and m are lengths of the arrays.
+    *
+    * @tparam T must be totally ordered and it must have defined >,<,= operators.
+    * @param a sorted array without duplicates.
+    * @param a_len length of the first array.
+    * @param b sorted array without duplicates.
+    * @param b_len length of the second array.
+    * @param out array for the result, at least Min(a_len, b_len) elements.
+    * @param compare optional strict weak ordering the arrays are sorted by.
+    * @param projection optional, elements are compared by projection(element).
+    * @return number of elements written to out.
+    */
+    template <typename T, typename Compare = Less, typename Projection = Identity>
+    ptrdiff_t ArrIntersect(T* a, ptrdiff_t a_len, T* b, ptrdiff_t b_len, T* out, Compare compare = Compare(), Projection projection = Projection()) {
+        return ArrSet::Intersect<T>(a, a_len, b, b_len, out, MakeOrder(compare, projection));
+    }
+
+    /**
+    * Size of the intersection of sorted sets, see ArrIntersect, nothing is written.
+    * T(n, m) = O(n + m), O(n log(m / n)) for n much smaller than m.
+    * S(n, m) = O(1), where n and m are lengths of the arrays.
+    *
+    * @return number of elements of a that are also in b.
+    */
+    template <typename T, typename Compare = Less, typename Projection = Identity>
+    ptrdiff_t ArrIntersectCount(T* a, ptrdiff_t a_len, T* b, ptrdiff_t b_len, Compare compare = Compare(), Projection projection = Projection()) {
+        return ArrSet::Intersect<T>(a, a_len, b, b_len, (T*)NULL, MakeOrder(compare, projection));
+    }
+
+    /**
+    * Union of sorted sets, writes elements of a and elements of b that are not in a to out, in order.
+    * If one array is more than ArrSet::GALLOP_RATIO times longer, runs of it between elements of the shorter
+    * one are found by galloping and copied.
+    * T(n, m) = O(n + m).
+    * S(n, m) = O(1), where n and m are lengths of the arrays.
+    *
+    * @tparam T must be totally ordered and it must have defined >,<,= operators.
+    * @param a sorted array without duplicates.
+    * @param a_len length of the first array.
+    * @param b sorted array without duplicates.
+    * @param b_len length of the second array.
+    * @param out array for the result, at least a_len + b_len elements.
+    * @param compare optional strict weak ordering the arrays are sorted by.
+    * @param projection optional, elements are compared by projection(element).
+    * @return number of elements written to out.
+    */
+    template <typename T, typename Compare = Less, typename Projection = Identity>
+    ptrdiff_t ArrUnion(T* a, ptrdiff_t a_len, T* b, ptrdiff_t b_len, T* out, Compare compare = Compare(), Projection projection = Projection()) {
+        return ArrSet::Union<T>(a, a_len, b, b_len, out, MakeOrder(compare, projection));
+    }
+
+    /**
+    * Difference of sorted sets, writes elements of a that are not in b to out.
+    * Strategies are the same as of ArrIntersect: vectorized blocks for int32_t, galloping for skewed lengths.
+    * T(n, m) = O(n + m), O(n log(m / n)) for n much smaller than m.
+    * S(n, m) = O(1), where n and m are lengths of the arrays.
+    *
+    * @tparam T must be totally ordered and it must have defined >,<,= operators.
+    * @param a sorted array without duplicates.
+    * @param a_len length of the first array.
+    * @param b sorted array without duplicates.
+    * @param b_len length of the second array.
+    * @param out array for the result, at least a_len elements.
+    * @param compare optional strict weak ordering the arrays are sorted by.
+    * @param projection optional, elements are compared by projection(element).
+    * @return number of elements written to out.
+    */
+    template <typename T, typename Compare = Less, typename Projection = Identity>
+    ptrdiff_t ArrDifference(T* a, ptrdiff_t a_len, T* b, ptrdiff_t b_len, T* out, Compare compare = Compare(), Projection projection = Projection()) {
+        return ArrSet::Difference<T>(a, a_len, b, b_len, out, MakeOrder(compare, projection));
+    }
+
+    // Operations used by arg sort.
+    namespace ArrArg {
+
+        template <typename T, typename Index, typename Compare>
+        void Sort(T* arr, ptrdiff_t len, Index* perm, Compare less) {
+            for(ptrdiff_t i=0; i<len; ++i) perm[i] = (Index)i;
+            ArrMergeSort<Index>(perm, len, NULL, IndexOrder<T, Compare>(arr, less));
+        }
+
+    }
+
+    /**
+    * Computes permutation that sorts the array, arr itself is not changed.
+    * After the call arr[perm[0]], arr[perm[1]], ... is sorted, indexes of equal elements stay
+    * in rising order (sort is stable).
+    * T(n) = O(n log(n)).
+    * S(n) = O(n), where n is arr size.
+    *
+    * @tparam T must be totally ordered and it must have defined >,<,= operators.
+    * @param arr array of elements.
+    * @param len length of the array.
+    * @param perm array of length len, sorting permutation will be assigned to it. Its type Index is deduced,
+    *             int is enough for arrays shorter than 2^31 and halves the sorted memory.
+    * @param compare optional strict weak ordering, compare(a, b) is true if a goes before b.
+    * @param projection optional, elements are compared by projection(element).
+    */
+    template <typename T, typename Compare = Less, typename Projection = Identity, typename Index>
+    void ArrArgSort(T* arr, ptrdiff_t len, Index* perm, Compare compare = Compare(), Projection projection = Projection()) {
+        ArrArg::Sort<T>(arr, len, perm, MakeOrder(compare, projection));
+    }
+
+    // Operations used by external merge sort.
+    namespace ExternalSort {
+
+        // Default memory budget in bytes.
+        const long long DEFAULT_MEMORY = 256LL << 20;
+
+        // Merged runs are read in blocks of at least this many bytes, which limits the number of runs merged at once.
+        const long long MIN_BLOCK_BYTES = 1LL << 20;
+
+        /**
+        * Settings of external merge sort.
+        *
+        * @param memory memory budget in bytes for buffered records.
+        * @param run_len number of records in one sorted run, 0 to derive it from memory.
+        * @param temp_dir directory for temporary run files, NULL for the system temporary directory.
+        * @param max_ways maximal number of runs merged at once, 0 to derive it from memory.
+        */
+        struct Config {
+            long long memory;
+            long long run_len;
+            const char* temp_dir;
+            int max_ways;
+            Config(): memory(DEFAULT_MEMORY), run_len(0), temp_dir(NULL), max_ways(0) {}
+        };
+
+        /**
+        * Reads up to len records, sets got to the number of records read.
+        */
+        template <typename T>
+        void ReadBlock(FILE* file, T* block, int len, int* got) {
+            *got = (int)fread(block, sizeof(T), len, file);
+        }
+
+        /**
+        * Writes len records, clears ok on failure.
+        */
+        template <typename T>
+        void WriteBlock(FILE* file, T* block, ptrdiff_t len, bool* ok) {
+            if(len > 0 && fwrite(block, sizeof(T), len, file) != (size_t)len) *ok = false;
+        }
+
+        /**
+        * Thread that runs posted transfers of blocks one after another, it is started by the first one
+        * and waits for the next one between them, so a reader or a writer does not start a thread per block.
+        */
+        class IOThread {
+            public:
+                IOThread(): job(NULL), context(NULL), posted(false), stop(false) {}
+
+                /**
+                * Waits for the previous transfer and runs job(context) in the thread.
+                */
+                void Post(void (*job)(void*), void* context) {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    while(posted) changed.wait(lock);
+                    this->job = job;
+                    this->context = context;
+                    posted = true;
+                    if(!worker.joinable()) worker = std::thread(&IOThread::Run, this);
+                    changed.notify_all();
+                }
+
+                /**
+                * Waits until the posted transfer is finished.
+                */
+                void Wait() {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    while(posted) changed.wait(lock);
+                }
+
+                ~IOThread() {
+                    if(!worker.joinable()) return;
+                    {
+                        std::unique_lock<std::mutex> lock(mutex);
+                        while(posted) changed.wait(lock);
+                        stop = true;
+                        changed.notify_all();
+                    }
+                    worker.join();
+                }
+
+            private:
+                void (*job)(void*);
+                void* context;
+                bool posted;
+                bool stop;
+                std::mutex mutex;
+                std::condition_variable changed;
+                std::thread worker;
+
+                IOThread(const IOThread&);
+                IOThread& operator=(const IOThread&);
+
+                void Run() {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    while(true) {
+                        while(!posted && !stop) changed.wait(lock);
+                        if(!posted) return;
+                        lock.unlock();
+                        job(context);
+                        lock.lock();
+                        posted = false;
+                        changed.notify_all();
+                    }
+                }
+        };
+
+        /**
+        * Sequential reader of records, the next block is read by its I/O thread while the current one is used.
+        */
+        template <typename T>
+        class Reader {
+            public:
+                Reader(): file(NULL), front(NULL), back(NULL), block_len(0), front_len(0), back_len(0), pos(0), loading(false) {}
+
+                /**
+                * Starts reading the file from its current position.
+                *
+                * @param buf buffer of 2*len records owned by the caller.
+                */
+                void Open(FILE* f, T* buf, int len) {
+                    file = f;
+                    front = buf;
+                    back = buf + len;
+                    block_len = len;
+                    front_len = 0;
+                    pos = 0;
+                    loading = true;
+                    io.Post(Load, this);
+                }
+
+                /**
+                * Assigns the next record to value, returns false at the end of the file.
+                */
+                bool Next(T* value) {
+                    if(pos == front_len) {
+                        if(!loading) return false;
+                        io.Wait();
+                        T* temp = front;
+                        front = back;
+                        back = temp;
+                        front_len = back_len;
+                        pos = 0;
+                        // short block means the end of the file
+                        loading = front_len == block_len;
+                        if(front_len == 0) return false;
+                        if(loading) io.Post(Load, this);
+                    }
+                    *value = front[pos++];
+                    return true;
+                }
+
+                /**
+                * Returns true if the file was read without errors.
+                */
+                bool Ok() { return !ferror(file); }
+
+            private:
+                FILE* file;
+                T* front;
+                T* back;
+                int block_len;
+                int front_len;
+                int back_len;
+                int pos;
+                bool loading;
+                IOThread io;
+
+                Reader(const Reader&);
+                Reader& operator=(const Reader&);
+
+                static void Load(void* reader) {
+                    Reader* r = (Reader*)reader;
+                    ReadBlock<T>(r->file, r->back, r->block_len, &r->back_len);
+                }
+        };
+
+        /**
+        * Sequential writer of records, a full block is written by its I/O thread while the next one is filled.
+        */
+        template <typename T>
+        class Writer {
+            public:
+                /**
+                * @param buf buffer of 2*len records owned by the caller.
+                */
+                Writer(FILE* f, T* buf, int len): file(f), front(buf), back(buf + len), block_len(len), front_len(0), ok(true) {}
+
+                void Put(const T& value) {
+                    front[front_len++] = value;
+                    if(front_len == block_len) {
+                        io.Wait();
+                        T* temp = front;
+                        front = back;
+                        back = temp;
+                        io.Post(Save, this);
+                        front_len = 0;
+                    }
+                }
+
+                /**
+                * Writes the rest of the records, returns false if any write failed.
+                */
+                bool Close() {
+                    io.Wait();
+                    WriteBlock<T>(file, front, front_len, &ok);
+                    front_len = 0;
+                    return ok && fflush(file) == 0;
+                }
+
+            private:
+                FILE* file;
+                T* front;
+                T* back;
+                int block_len;
+                int front_len;
+                bool ok;
+                IOThread io;
+
+                Writer(const Writer&);
+                Writer& operator=(const Writer&);
+
+                static void Save(void* writer) {
+                    Writer* w = (Writer*)writer;
+                    WriteBlock<T>(w->file, w->back, w->block_len, &w->ok);
+                }
+        };
+
+        /**
+        * Merge heap entry, the next record of a run.
+        */
+        template <typename T>
+        struct Head {
+            T value;
+            int run;
+        };
+
+        /**
+        * Heap order of run heads, the smallest record is on top.
+        */
+        template <typename T, typename Compare>
+        struct HeadOrder {
+            Compare less;
+            HeadOrder(Compare l): less(l) {}
+            bool operator()(const Head<T>& a, const Head<T>& b) const { return less(b.value, a.value); }
+        };
+
+        /**
+        * Merges sorted runs into out by a 4-ary heap of run heads.
+        * T(n) = O(n log(k)), where k is the number of runs.
+        * S(n) = O(k * block_len).
+        *
+        * @param runs files positioned at the beginning of the sorted runs.
+        * @param ways number of runs.
+        * @param block_len length of one read or write block in records.
+        * @param buf buffer of (2*ways + 2) * block_len records.
+        * @return false if reading or writing failed.
+        */
+        template <typename T, typename Compare>
+        bool Merge(FILE** runs, int ways, FILE* out, int block_len, T* buf, Compare less) {
+            Reader<T>* readers = new Reader<T>[ways];
+            Head<T>* heap = new Head<T>[ways];
+            int heap_len = 0;
+            for(int i=0; i<ways; ++i) {
+                readers[i].Open(runs[i], buf + 2LL*i*block_len, block_len);
+                if(readers[i].Next(&heap[heap_len].value)) heap[heap_len++].run = i;
+            }
+            HeadOrder<T, Compare> order(less);
+            ArrHeap::Build<Head<T>, 4>(heap, heap_len, order);
+            Writer<T> writer(out, buf + 2LL*ways*block_len, block_len);
+            while(heap_len > 0) {
+                writer.Put(heap[0].value);
+                if(!readers[heap[0].run].Next(&heap[0].value)) heap[0] = heap[--heap_len];
+                ArrHeap::SiftDown<Head<T>, 4>(heap, heap_len, 0, order);
+            }
+            bool ok = writer.Close();
+            for(int i=0; i<ways; ++i) ok = ok && readers[i].Ok();
+            delete[] heap;
+            delete[] readers;
+            return ok;
+        }
+
+        /**
+        * Opens a new temporary file for reading and writing.
+        * The file is removed right away, on POSIX systems it exists until it is closed.
+        */
+        inline FILE* OpenTemp(const char* temp_dir, unsigned long long stamp, int id) {
+            if(temp_dir == NULL) return tmpfile();
+            char name[4096];
+            snprintf(name, sizeof(name), "%s/algo_sort_%llx_%d.tmp", temp_dir, stamp, id);
+            FILE* file = fopen(name, "w+b");
+            if(file) remove(name);
+            return file;
+        }
+
+        /**
+        * Sorts file of records by external merge sort.
+        * Sorted runs are written while the next run is read and sorted, runs are then merged
+        * max_ways at once until one is left, which is written to out_path.
+        */
+        template <typename T, typename Compare>
+        bool Sort(const char* in_path, const char* out_path, Config config, Compare less) {
+            long long memory = Max<long long>(config.memory, 2 * (long long)sizeof(T));
+            long long run_len = config.run_len > 0? config.run_len: memory / (2 * (long long)sizeof(T));
+            run_len = Max<long long>(1, run_len);
+            int max_ways = config.max_ways > 0? config.max_ways: (int)Min<long long>(memory / MIN_BLOCK_BYTES / 2 - 1, 1 << 12);
+            max_ways = Max<int>(max_ways, 2);
+            unsigned long long stamp = (unsigned long long)std::chrono::steady_clock::now().time_since_epoch().count()
+                                       ^ (unsigned long long)(size_t)&config;
+            int temp_count = 0;
+
+            FILE* in = fopen(in_path, "rb");
+            if(in == NULL) return false;
+
+            // runs are sorted in one buffer while the previous run is written from the other one
+            T* buf = new T[2*run_len];
+            T* run = buf;
+            T* written = buf + run_len;
+            std::thread saver;
+            bool ok = true;
+            bool saved = true;
+            int runs_len = 0;
+            int runs_cap = 16;
+            FILE** runs = new FILE*[runs_cap];
+            while(ok) {
+                size_t bytes = fread(run, 1, (size_t)run_len * sizeof(T), in);
+                // file length must be a multiple of the record size
+                if(ferror(in) || bytes % sizeof(T) != 0) {
+                    ok = false;
+                    break;
+                }
+                ptrdiff_t len = (ptrdiff_t)(bytes / sizeof(T));
+                if(len == 0) break;
+                ArrQuickSort<T>(run, len, less);
+                bool last = len < run_len;
+                if(!last) {
+                    int c = fgetc(in);
+                    if(c == EOF) last = true;
+                    else ungetc(c, in);
+                }
+                // whole input fits into one run, no temporary files are needed
+                if(runs_len == 0 && last) {
+                    fclose(in);
+                    in = NULL;
+                    FILE* out = fopen(out_path, "wb");
+                    if(out == NULL) ok = false;
+                    else {
+                        WriteBlock<T>(out, run, len, &ok);
+                        ok = (fclose(out) == 0) && ok;
+                    }
+                    break;
+                }
+                if(saver.joinable()) saver.join();
+                FILE* file = OpenTemp(config.temp_dir, stamp, temp_count++);
+                if(file == NULL) {
+                    ok = false;
+                    break;
+                }
+                if(runs_len == runs_cap) {
+                    FILE** grown = new FILE*[2*runs_cap];
+                    for(int i=0; i<runs_len; ++i) grown[i] = runs[i];
+                    delete[] runs;
+                    runs = grown;
+                    runs_cap *= 2;
+                }
+                runs[runs_len++] = file;
+                saver = std::thread(WriteBlock<T>, file, run, len, &saved);
+                T* temp = run;
+                run = written;
+                written = temp;
+            }
+            if(saver.joinable()) saver.join();
+            ok = ok && saved;
+            if(in != NULL) fclose(in);
+            delete[] buf;
+
+            // merge passes, the last one writes to out_path
+            if(ok && runs_len > 0) {
+                int ways = Min<int>(runs_len, max_ways);
+                int block_len = (int)Max<long long>(1, Min<long long>(memory / ((2LL*ways + 2) * (long long)sizeof(T)), 1 << 24));
+                buf = new T[(2LL*ways + 2) * block_len];
+                while(ok && runs_len > 0) {
+                    for(int i=0; i<runs_len; ++i) {
+                        if(fflush(runs[i]) != 0) ok = false;
+                        rewind(runs[i]);
+                    }
+                    if(!ok) break;
+                    if(runs_len <= max_ways) {
+                        FILE* out = fopen(out_path, "wb");
+                        if(out == NULL) ok = false;
+                        else {
+                            ok = Merge<T>(runs, runs_len, out, block_len, buf, less);
+                            ok = (fclose(out) == 0) && ok;
+                        }
+                        break;
+                    }
+                    // after a failure the remaining groups are not merged, but their runs are still closed
+                    int merged_len = 0;
+                    for(int i=0; i<runs_len; i+=max_ways) {
+                        int group = Min<int>(max_ways, runs_len-i);
+                        FILE* file = ok? OpenTemp(config.temp_dir, stamp, temp_count++): NULL;
+                        if(file == NULL) ok = false;
+                        else ok = Merge<T>(runs+i, group, file, block_len, buf, less);
+                        for(int j=i; j<i+group; ++j) {
+                            fclose(runs[j]);
+                            runs[j] = NULL;
+                        }
+                        runs[merged_len++] = file;
+                    }
+                    runs_len = merged_len;
+                }
+                delete[] buf;
+            }
+            for(int i=0; i<runs_len; ++i) if(runs[i] != NULL) fclose(runs[i]);
+            delete[] runs;
+            return ok;
+        }
+
+    }
+
+    /**
+    * Sorts file of fixed-size binary records that does not fit into memory, by external merge sort.
+    * Input is read in runs that are sorted in memory by ArrQuickSort and spilled to temporary files,
+    * runs are then merged by a heap of run heads, several passes are made if there are more runs than
+    * config.max_ways. Reads and writes are sequential in large blocks and overlap with sorting and
+    * merging (double buffering). Sort is not stable. in_path and out_path can be the same file.
+    * T(n) = O(n log(n)), O(n log(n) / B * log_k(n / M)) blocks of B records are transferred,
+    *        where M is the run length and k the number of runs merged at once.
+    * S(n) = O(M) memory given by config.memory, O(n) disk space for the runs.
+    *
+    * @tparam T record type, copied byte by byte, it must be trivially copyable.
+    * @param in_path file with records, its size must be a multiple of sizeof(T).
+    * @param out_path file the sorted records will be written to.
+    * @param config optional memory budget, run length, temporary directory and merge width.
+    * @param compare optional strict weak ordering, compare(a, b) is true if a goes before b.
+    * @param projection optional, elements are compared by projection(element).
+    * @return true on success, false if a file could not be read or written.
+    */
+    template <typename T, typename Compare = Less, typename Projection = Identity>
+    bool ExternalMergeSort(const char* in_path, const char* out_path, ExternalSort::Config config = ExternalSort::Config(),
+                           Compare compare = Compare(), Projection projection = Projection()) {
+        static_assert(std::is_trivially_copyable<T>::value, "ExternalMergeSort stores records byte by byte, T must be trivially copyable");
+        return ExternalSort::Sort<T>(in_path, out_path, config, MakeOrder(compare, projection));
+    }
+
+    // Node allocators of lists and trees. Every list and tree owns a copy of its allocator, takes memory for a node
+    // from Allocate(bytes) and returns it by Free(pointer, bytes). If RELEASES_ALL, Release() frees all nodes at once
+    // and containers of trivially destructible elements clear themselves by it, without visiting their nodes.
+
+    /**
+    * Allocates every node by operator new, the default allocator of containers.
+    */
+    struct NewAllocator {
+        enum { RELEASES_ALL = 0 };
+
+        void* Allocate(size_t bytes) {
+            ALGO_STAT(allocations, 1);
+            return ::operator new(bytes);
+        }
+
+        void Free(void* node, size_t) { ::operator delete(node); }
+
+        void Release() {}
+    };
+
+    // Operations used by node allocators.
+    namespace Memory {
+
+        // Alignment of nodes, pool size classes are its multiples.
+        const int ALIGN = 16;
+        // Pools serve nodes of at most POOL_CLASSES * ALIGN bytes, larger nodes are allocated by operator new.
+        const int POOL_CLASSES = 16;
+        // Bytes of one slab of a pool.
+        const int SLAB_BYTES = 64 * 1024;
+        // Bytes of the first block of an arena, every next block is twice as large up to ARENA_MAX_BLOCK.
+        const size_t ARENA_BLOCK = 64 * 1024;
+        const size_t ARENA_MAX_BLOCK = 64 * 1024 * 1024;
+
+        /**
+        * Nodes of one size class in one thread. Returned nodes are linked in the free list by their first
+        * word, new nodes are cut from the last slab. Slabs are freed when the thread exits, unless some of
+        * their nodes are still in use by a container that outlives the thread.
+        */
+        struct Pool {
+            void* free;
+            char* next;
+            char* end;
+            void* slabs;
+            ptrdiff_t used;
+
+            Pool(): free(NULL), next(NULL), end(NULL), slabs(NULL), used(0) {}
+
+            ~Pool() {
+                if(used != 0) return;
+                while(slabs != NULL) {
+                    void* slab = slabs;
+                    slabs = *(void**)slab;
+                    ::operator delete(slab);
+                }
+            }
+        };
+
+        inline Pool& ThreadPool(size_t size_class) {
+            static thread_local Pool pools[POOL_CLASSES];
+            return pools[size_class];
+        }
+
+        /**
+        * Destroys node and returns its memory to alloc.
+        */
+        template <typename Node, typename Alloc>
+        inline void Delete(Alloc& alloc, Node* node) {
+            node->~Node();
+            alloc.Free(node, sizeof(Node));
+        }
+
+        /**
+        * True if containers of T can drop all nodes by Alloc::Release().
+        */
+        template <typename T, typename Alloc>
+        struct ReleasesAll {
+            enum { value = Alloc::RELEASES_ALL && std::is_trivially_destructible<T>::value };
+        };
+
+    }
+
+    /**
+    * Allocates nodes from slabs of 64 kB kept by the calling thread for each node size, so allocation and
+    * deallocation of a node is a pop or push of a free list or a pointer bump. All copies share the pools
+    * of the thread, a container with PoolAllocator has to be used and destroyed by one thread.
+    */
+    struct PoolAllocator {
+        enum { RELEASES_ALL = 0 };
+
+        void* Allocate(size_t bytes) {
+            size_t size_class = (bytes - 1) / Memory::ALIGN;
+            if(size_class >= (size_t)Memory::POOL_CLASSES) return NewAllocator().Allocate(bytes);
+            Memory::Pool& pool = Memory::ThreadPool(size_class);
+            ++pool.used;
+            void* node = pool.free;
+            if(node != NULL) {
+                pool.free = *(void**)node;
+                return node;
+            }
+            size_t node_bytes = (size_class + 1) * Memory::ALIGN;
+            if((size_t)(pool.end - pool.next) < node_bytes) {
+                ALGO_STAT(allocations, 1);
+                char* slab = (char*)::operator new(Memory::SLAB_BYTES);
+                *(void**)slab = pool.slabs;
+                pool.slabs = slab;
+                pool.next = slab + Memory::ALIGN;
+                pool.end = slab + Memory::SLAB_BYTES;
+            }
+            node = pool.next;
+            pool.next += node_bytes;
+            return node;
+        }
+
+        void Free(void* node, size_t bytes) {
+            size_t size_class = (bytes - 1) / Memory::ALIGN;
+            if(size_class >= (size_t)Memory::POOL_CLASSES) return NewAllocator().Free(node, bytes);
+            Memory::Pool& pool = Memory::ThreadPool(size_class);
+            --pool.used;
+            *(void**)node = pool.free;
+            pool.free = node;
+        }
+
+        void Release() {}
+    };
+
+    /**
+    * Monotonic arena for containers that are built once and then discarded. Nodes are cut from blocks
+    * by a pointer bump and never freed one by one, Release() frees the blocks, which double in size,
+    * so a tree of a million nodes is dropped by a few calls of operator delete. Memory of removed
+    * nodes is reused only after Release(). A copy starts empty with the same size of the next block.
+    */
+    class ArenaAllocator {
+        public:
+            enum { RELEASES_ALL = 1 };
+
+            ArenaAllocator(size_t first_block = Memory::ARENA_BLOCK): block_bytes(first_block), blocks(NULL), next(NULL), end(NULL) {}
+
+            ArenaAllocator(const ArenaAllocator& other): block_bytes(other.block_bytes), blocks(NULL), next(NULL), end(NULL) {}
+
+            ~ArenaAllocator() { Release(); }
+
+            void* Allocate(size_t bytes) {
+                bytes = (bytes + Memory::ALIGN - 1) & ~(size_t)(Memory::ALIGN - 1);
+                if((size_t)(end - next) < bytes) Grow(bytes);
+                void* node = next;
+                next += bytes;
+                return node;
+            }
+
+            void Free(void*, size_t) {}
+
+            void Release() {
+                while(blocks != NULL) {
+                    void* block = blocks;
+                    blocks = *(void**)block;
+                    ::operator delete(block);
+                }
+                next = NULL;
+                end = NULL;
+            }
+
+        private:
+            size_t block_bytes;
+            void* blocks;
+            char* next;
+            char* end;
+
+            ArenaAllocator& operator=(const ArenaAllocator&);
+
+            void Grow(size_t bytes) {
+                size_t size = Max<size_t>(block_bytes, bytes + Memory::ALIGN);
+                ALGO_STAT(allocations, 1);
+                char* block = (char*)::operator new(size);
+                *(void**)block = blocks;
+                blocks = block;
+                next = block + Memory::ALIGN;
+                end = block + size;
+                if(block_bytes < Memory::ARENA_MAX_BLOCK) block_bytes *= 2;
+            }
+    };
+
+    /**
+    * Node for singly linked list
+    * 
+    * @param value Value stored in the node
+    * @param next Pointer to next node
+    */
+    template <typename T>
+    struct SinglyLLNode {
+        T value;
+        SinglyLLNode<T>* next;
+        /**
+        * Constructs the value in place from args.
+        */
+        template <typename... Args>
+        SinglyLLNode(SinglyLLNode<T>* n, Args&&... args): value(std::forward<Args>(args)...), next(n) {}
+    };
+     
+    /**
+    * Singly linked list with O(1) Inset, Append and Remove First.
+    * 
+    * ...
+    *
+    * @tparam T the type of data stored in the list.
+    * @tparam Alloc allocator of the nodes, NewAllocator, PoolAllocator or ArenaAllocator.
+    */
+    template <typename T, typename Alloc = NewAllocator>
+    class SinglyLL {
+        public:
+            SinglyLL(Alloc alloc = Alloc()): length(0), first(NULL), last(NULL), alloc(alloc) {}
+
+            ~SinglyLL() { Clear(); }
+            
+            /**
+            * Inserts new element at the end of the linked list.
+            * T(n) = O(1).
+            * S(n) = O(1).
+            *
+            * @param data element for insertion.
+            */
+            void Append(const T& data) { EmplaceAppend(data); }
+
+            /**
+            * Moves new element at the end of the linked list.
+            * T(n) = O(1).
+            * S(n) = O(1).
+            *
+            * @param data element for insertion, it is left in moved-from state.
+            */
+            void Append(T&& data) { EmplaceAppend(std::move(data)); }
+
+            /**
+            * Constructs new element at the end of the linked list in place.
+            * T(n) = O(1).
+            * S(n) = O(1).
+            *
+            * @param args arguments of the constructor of T.
+            */
+            template <typename... Args>
+            void EmplaceAppend(Args&&... args) {
+                SinglyLLNode<T>* node = new(alloc.Allocate(sizeof(SinglyLLNode<T>))) SinglyLLNode<T>(NULL, std::forward<Args>(args)...);
+                if (length == 0) {
+                    first = node;
+                    last = node;
+                }
+                else {
+                    last->next = node;
+                    last = node;
+                }
+                ++length;
+            }
+            
+            
+            /**
+            * Inserts new element at the beginning of the list.
+            * T(n) = O(1).
+            * S(n) = O(1).
+            *
+            * @param data element for insertion.
+            */
+            void Insert(const T& data) { EmplaceInsert(data); }
+
+            /**
+            * Moves new element at the beginning of the list.
+            * T(n) = O(1).
+            * S(n) = O(1).
+            *
+            * @param data element for insertion, it is left in moved-from state.
+            */
+            void Insert(T&& data) { EmplaceInsert(std::move(data)); }
+
+            /**
+            * Constructs new element at the beginning of the list in place.
+            * T(n) = O(1).
+            * S(n) = O(1).
+            *
+            * @param args arguments of the constructor of T.
+            */
+            template <typename... Args>
+            void EmplaceInsert(Args&&... args) {
+                SinglyLLNode<T>* node = new(alloc.Allocate(sizeof(SinglyLLNode<T>))) SinglyLLNode<T>(first, std::forward<Args>(args)...);
+                if (length == 0) last = node;
+                first = node; 
+                ++length;
+            }
+
+            
+            /**
+            * Removes first element from the list.
+            * T(n) = O(1).
+            * S(n) = O(1).
+            *
+            * @return value data of removed element, moved out of the node.
+            */
+            T RemoveFirst() {
+                T returnValue = std::move(first->value);
+                SinglyLLNode<T>* temp = first;
+                first = first->next;
+                if(first == NULL) last = NULL;
+                Memory::Delete(alloc, temp);
+                --length;
+                return returnValue;
+            }
+
+            /**
+            * Removes all elements from list.
+            * T(n) = O(n) where n is the number of stored elements.
+            * S(n) = O(1).
+            *
+            * @param data element for insertion.
+            */
+            void Clear() {
+                if(Memory::ReleasesAll<T, Alloc>::value) {
+                    first = NULL;
+                    length = 0;
+                }
+                while(first != NULL) RemoveFirst();
+                alloc.Release();
+            }
+            
+            /**
+            * Returns true if the structure is empty.
+            * T(n) = O(1).
+            * S(n) = O(1).
+            */
+            bool IsEmpty() {
+                if(length == 0) return true;
+                else return false;
+            }
+
+
+            /**
+            * Returns length of the list.
+            * T(n) = O(1).
+            * S(n) = O(1).
+            */
+            int Length() {
+                return length;
+            }
+
+        protected:
+            int length;
+            SinglyLLNode<T>* first; 
+            SinglyLLNode<T>* last; 
+            Alloc alloc;
+
+        private:
+            SinglyLL(const SinglyLL&);
+            SinglyLL& operator=(const SinglyLL&);
+
+    };
+    
+    
+    /**
+    * Node for doubly linked list
+    * 
+    * @param value Value stored in the node
+    * @param next Pointer to next node
+    * @param prev Pointer to previous node
+    */
+    template <typename T>
+    struct DoublyLLNode {
+        T value;
+        DoublyLLNode<T>* next;
+        DoublyLLNode<T>* prev;
+        /**
+        * Constructs the value in place from args.
+        */
+        template <typename... Args>
+        DoublyLLNode(DoublyLLNode<T>* n, DoublyLLNode<T>* p, Args&&... args): value(std::forward<Args>(args)...), next(n), prev(p) {}
+    };
+    
+    
+    /**
+    * Doubly linked list with O(1) Inset, Append, Remove First and Remove Last.
+    * 
+    * ...
+    *
+    * @tparam T the type of data stored in the list.
+    */
+    template <typename T, typename Alloc = NewAllocator>
+    class DoublyLL { 
+        public:
+            DoublyLLNode<T>* first;
+            DoublyLLNode<T>* last;
+
+            DoublyLL(Alloc alloc = Alloc()): first(NULL), last(NULL), length(0), alloc(alloc) {};
+            ~DoublyLL() { Clear(); }
+
+            /**
+            * Inserts new element at the end of the list.
+            * T(n) = O(1).
+            * S(n) = O(1).
+            *
+            * @param data element for insertion.
+            */
+            void Append(const T& data) { EmplaceAppend(data); }
+
+            /**
+            * Moves new element at the end of the list.
+            * T(n) = O(1).
+            * S(n) = O(1).
+            *
+            * @param data element for insertion, it is left in moved-from state.
+            */
+            void Append(T&& data) { EmplaceAppend(std::move(data)); }
+
+            /**
+            * Constructs new element at the end of the list in place.
+            * T(n) = O(1).
+            * S(n) = O(1).
+            *
+            * @param args arguments of the constructor of T.
+            */
+            template <typename... Args>
+            void EmplaceAppend(Args&&... args) {
+                DoublyLLNode<T>* node = new(alloc.Allocate(sizeof(DoublyLLNode<T>))) DoublyLLNode<T>(NULL, last, std::forward<Args>(args)...);
+                if (length == 0) first = node;
+                else last->next = node;
+                last = node;
+                ++length;
+            }
+            
+            
+            /**
+            * Inserts new element at the beginning of the list.
+            * T(n) = O(1).
+            * S(n) = O(1).
+            *
+            * @param data element for insertion.
+            */
+            void Insert(const T& data) { EmplaceInsert(data); }
+
+            /**
+            * Moves new element at the beginning of the list.
+            * T(n) = O(1).
+            * S(n) = O(1).
+            *
+            * @param data element for insertion, it is left in moved-from state.
+            */
+            void Insert(T&& data) { EmplaceInsert(std::move(data)); }
+
+            /**
+            * Constructs new element at the beginning of the list in place.
+            * T(n) = O(1).
+            * S(n) = O(1).
+            *
+            * @param args arguments of the constructor of T.
+            */
+            template <typename... Args>
+            void EmplaceInsert(Args&&... args) {
+                DoublyLLNode<T>* node = new(alloc.Allocate(sizeof(DoublyLLNode<T>))) DoublyLLNode<T>(first, NULL, std::forward<Args>(args)...);
+                if (length == 0) last = node;
+                else first->prev = node;
+                first = node; 
+                ++length;
+            }
+            
+            
+            /**
+            * Removes last element from the list.
+            * T(n) = O(1).
+            * S(n) = O(1).
+            *
+            * @return value data of removed element, moved out of the node.
+            */
+            T RemoveLast() {
+                T returnValue = std::move(last->value);
+                DoublyLLNode<T>* temp = last;
+                last = last->prev;
+                if(last == NULL) first = NULL;
+                else last->next = NULL;
+                Memory::Delete(alloc, temp);
+                --length;
+                return returnValue;
+            }
+
+            /**
+            * Removes first element from the list.
+            * T(n) = O(1).
+            * S(n) = O(1).
+            *
+            * @return value data of removed element, moved out of the node.
+            */
+            T RemoveFirst() {
+                T returnValue = std::move(first->value);
+                DoublyLLNode<T>* temp = first;
+                first = first->next;
+                if(first == NULL) last = NULL;
+                else first->prev = NULL;
+                Memory::Delete(alloc, temp);
+                --length;
+                return returnValue;
+            }
+            
+            /**
+            * Removes all elements from list.
+            * T(n) = O(n) where n is the number of stored elements.
+            * S(n) = O(1).
+            *
+            * @param data element for insertion.
+            */
+
+            void Clear() {
+                if(Memory::ReleasesAll<T, Alloc>::value) {
+                    first = NULL;
+                    last = NULL;
+                    length = 0;
+                }
+                while(first != NULL) RemoveFirst();
+                alloc.Release();
+            }
+            /**
+            * Returns true if the structure is empty.
+            * T(n) = O(1).
+            * S(n) = O(1).
+            */
+            bool IsEmpty() {
+                if(length == 0) return true;
+                else return false;
+            }
+
+            /**
+            * Returns length of the list.
+            * T(n) = O(1).
+            * S(n) = O(1).
+            */
+            int Length() {
+                return length;
+            }
 
-    /**
-    * Node for singly linked list
-    * 
-    * @param value Value stored in the node
-    * @param next Pointer to next node
-    */
-    template <typename T>
-    struct SinglyLLNode {
-        T value;
-        SinglyLLNode<T>* next;
-        SinglyLLNode(T v, SinglyLLNode<T>* n) {
-            value = v;
-            next = n;
-        }
+        private:
+            int length;
+            Alloc alloc;
+
+            DoublyLL(const DoublyLL&);
+            DoublyLL& operator=(const DoublyLL&);
     };
-     
+
     /**
-    * Singly linked list with O(1) Inset, Append and Remove First.
+    * First in first out data structure with O(1) Delete and amortized O(1) Insert.
     * 
-    * ...
+    * Elements are stored in a ring buffer, whose capacity is a power of two, so positions wrap by a mask.
+    * When it is full, it is moved into a buffer twice as large.
+    * The buffer is uninitialized memory, only the slots of the elements hold constructed objects.
     *
-    * @tparam T the type of data stored in the list.
+    * @tparam T the type of data stored in the structure.
     */
     template <typename T>
-    class SinglyLL {
-        public:
-            SinglyLL(): length(0), first(NULL) {}
+    class FIFO {
+        public: 
+            // Smallest capacity of the buffer.
+            static const ptrdiff_t MIN_CAPACITY = 16;
+
+            FIFO(ptrdiff_t capacity = 0): buf(NULL), capacity(0), head(0), length(0) { Reserve(capacity); }
+
+            ~FIFO() {
+                for(ptrdiff_t i=0; i<length; ++i) buf[(head + i) & (capacity - 1)].~T();
+                ::operator delete(buf);
+            }
             
             /**
-            * Inserts new element at the end of the linked list.
-            * T(n) = O(1).
+            * Inserts new element into structure.
+            * T(n) = O(1) amortized.
             * S(n) = O(1).
             *
             * @param data element for insertion.
             */
-            void Append(T data) {
-                SinglyLLNode<T>* node = new SinglyLLNode<T>(data, NULL);
-                if (length == 0) {
-                    first = node;
-                    last = node;
-                }
-                else {
-                    last->next = node;
-                    last = node;
-                }
+            void Insert(const T& data) { Emplace(data); }
+
+            /**
+            * Moves new element into structure.
+            * T(n) = O(1) amortized.
+            * S(n) = O(1).
+            *
+            * @param data element for insertion, it is left in moved-from state.
+            */
+            void Insert(T&& data) { Emplace(std::move(data)); }
+
+            /**
+            * Constructs new element in its slot of the buffer in place.
+            * T(n) = O(1) amortized.
+            * S(n) = O(1).
+            *
+            * @param args arguments of the constructor of T.
+            */
+            template <typename... Args>
+            void Emplace(Args&&... args) {
+                if(length == capacity) Resize(Max<ptrdiff_t>(2*capacity, MIN_CAPACITY));
+                new(&buf[(head + length) & (capacity - 1)]) T(std::forward<Args>(args)...);
                 ++length;
             }
             
-            
             /**
-            * Inserts new element at the beginning of the list.
+            * Removes the element, that has been in the structure for the longest time.
             * T(n) = O(1).
             * S(n) = O(1).
             *
-            * @param data element for insertion.
+            * @return value data of the removed element, moved out of the buffer.
             */
-            void Insert(T data) {
-                if (length == 0) Append(data);
-                else {
-                    SinglyLLNode<T>* node = new SinglyLLNode<T>(data, first);
-                    first = node; 
-                    ++length;
-                }
+            T Remove() {
+                T value = std::move(buf[head]);
+                buf[head].~T();
+                head = (head + 1) & (capacity - 1);
+                --length;
+                return value;
             }
-
             
             /**
-            * Removes first element from the list.
+            * Returns true if the structure is empty.
+            * T(n) = O(1).
+            * S(n) = O(1).
+            */
+            bool IsEmpty() { return length == 0; }
+
+            /**
+            * Returns number of elements in the structure.
+            * T(n) = O(1).
+            * S(n) = O(1).
+            */
+            ptrdiff_t Length() { return length; }
+
+            /**
+            * Returns number of elements the structure holds without growing.
             * T(n) = O(1).
             * S(n) = O(1).
+            */
+            ptrdiff_t Capacity() { return capacity; }
+
+            /**
+            * Grows the buffer to hold at least capacity elements.
+            * T(n) = O(n) if the buffer grows, O(1) otherwise.
+            * S(n) = O(capacity).
             *
-            * @return value data of removed element.
+            * @param capacity number of elements.
             */
-            T RemoveFirst() {
-                T returnValue = first->value;
-                SinglyLLNode<T>* temp = first;
-                first = first->next;
-                delete(temp);
-                --length;
-                return returnValue;
+            void Reserve(ptrdiff_t capacity) {
+                if(capacity > this->capacity) Resize(RoundCapacity(capacity));
             }
 
             /**
-            * Removes all elements from list.
-            * T(n) = O(n) where n is the number of stored elements.
+            * Shrinks the buffer to the smallest power of two that holds the elements.
+            * T(n) = O(n).
+            * S(n) = O(n), where n is the number of elements.
+            */
+            void ShrinkToFit() {
+                ptrdiff_t fit = RoundCapacity(length);
+                if(fit < capacity) Resize(fit);
+            }
+
+        private:
+            T* buf;
+            ptrdiff_t capacity;
+            ptrdiff_t head;
+            ptrdiff_t length;
+
+            FIFO(const FIFO&);
+            FIFO& operator=(const FIFO&);
+
+            static ptrdiff_t RoundCapacity(ptrdiff_t capacity) {
+                ptrdiff_t rounded = MIN_CAPACITY;
+                while(rounded < capacity) rounded *= 2;
+                return rounded;
+            }
+
+            // moves the elements in order to the start of a new buffer
+            void Resize(ptrdiff_t new_capacity) {
+                T* new_buf = (T*)::operator new(new_capacity * sizeof(T));
+                ALGO_STAT(allocations, 1);
+                for(ptrdiff_t i=0; i<length; ++i) {
+                    T& element = buf[(head + i) & (capacity - 1)];
+                    new(&new_buf[i]) T(std::move(element));
+                    element.~T();
+                }
+                ::operator delete(buf);
+                buf = new_buf;
+                capacity = new_capacity;
+                head = 0;
+            }
+    };
+    
+    
+    /**
+    * Last in first out storage for data with O(1) Delete and amortized O(1) Insert.
+    * 
+    * Elements are stored in an array, which is moved into an array twice as large when it is full.
+    * The array is uninitialized memory, only its first Length() slots hold constructed objects.
+    *
+    * @tparam T the type of data stored in the structure.
+    */
+    template <typename T>
+    class LIFO {
+        public: 
+            // Smallest capacity of the array.
+            static const ptrdiff_t MIN_CAPACITY = 16;
+
+            LIFO(ptrdiff_t capacity = 0): buf(NULL), capacity(0), length(0) { Reserve(capacity); }
+
+            ~LIFO() {
+                for(ptrdiff_t i=0; i<length; ++i) buf[i].~T();
+                ::operator delete(buf);
+            }
+        
+            /**
+            * Inserts new element into structure.
+            * T(n) = O(1) amortized.
             * S(n) = O(1).
             *
             * @param data element for insertion.
             */
-            void Clear() {
-                while(first != NULL) RemoveFirst();
+            void Insert(const T& data) { Emplace(data); }
+
+            /**
+            * Moves new element into structure.
+            * T(n) = O(1) amortized.
+            * S(n) = O(1).
+            *
+            * @param data element for insertion, it is left in moved-from state.
+            */
+            void Insert(T&& data) { Emplace(std::move(data)); }
+
+            /**
+            * Constructs new element at the end of the array in place.
+            * T(n) = O(1) amortized.
+            * S(n) = O(1).
+            *
+            * @param args arguments of the constructor of T.
+            */
+            template <typename... Args>
+            void Emplace(Args&&... args) {
+                if(length == capacity) Resize(Max<ptrdiff_t>(2*capacity, MIN_CAPACITY));
+                new(&buf[length]) T(std::forward<Args>(args)...);
+                ++length;
             }
-            
+
             /**
-            * Returns true if the structure is empty.
+            * Removes the element, that has been in the structure for the shortest time.
             * T(n) = O(1).
             * S(n) = O(1).
+            *
+            * @return value data of the removed element, moved out of the array.
             */
-            bool IsEmpty() {
-                if(length == 0) return true;
-                else return false;
+            T Remove() {
+                T value = std::move(buf[--length]);
+                buf[length].~T();
+                return value;
             }
+     
+            /**
+            * Returns true if the structure is empty.
+            * T(n) = O(1).
+            * S(n) = O(1).
+            */
+            bool IsEmpty() { return length == 0; }
 
+            /**
+            * Returns number of elements in the structure.
+            * T(n) = O(1).
+            * S(n) = O(1).
+            */
+            ptrdiff_t Length() { return length; }
 
             /**
-            * Returns length of the list.
+            * Returns number of elements the structure holds without growing.
             * T(n) = O(1).
             * S(n) = O(1).
             */
-            int Length() {
-                return length;
+            ptrdiff_t Capacity() { return capacity; }
+
+            /**
+            * Grows the array to hold at least capacity elements.
+            * T(n) = O(n) if the array grows, O(1) otherwise.
+            * S(n) = O(capacity).
+            *
+            * @param capacity number of elements.
+            */
+            void Reserve(ptrdiff_t capacity) {
+                if(capacity > this->capacity) Resize(capacity);
             }
 
-        protected:
-            int length;
-            SinglyLLNode<T>* first; 
-            SinglyLLNode<T>* last; 
+            /**
+            * Shrinks the array to the number of elements, but at least MIN_CAPACITY.
+            * T(n) = O(n).
+            * S(n) = O(n), where n is the number of elements.
+            */
+            void ShrinkToFit() {
+                ptrdiff_t fit = Max<ptrdiff_t>(length, MIN_CAPACITY);
+                if(fit < capacity) Resize(fit);
+            }
+
+        private:
+            T* buf;
+            ptrdiff_t capacity;
+            ptrdiff_t length;
+
+            LIFO(const LIFO&);
+            LIFO& operator=(const LIFO&);
 
+            void Resize(ptrdiff_t new_capacity) {
+                T* new_buf = (T*)::operator new(new_capacity * sizeof(T));
+                ALGO_STAT(allocations, 1);
+                for(ptrdiff_t i=0; i<length; ++i) {
+                    new(&new_buf[i]) T(std::move(buf[i]));
+                    buf[i].~T();
+                }
+                ::operator delete(buf);
+                buf = new_buf;
+                capacity = new_capacity;
+            }
     };
     
     
+    // Operations used by concurrent queues.
+    namespace Concurrent {
+
+        // Bytes of a cache line, data written by different threads is kept at least this far apart.
+        const int CACHE_LINE = 64;
+
+        inline ptrdiff_t RoundCapacity(ptrdiff_t capacity) {
+            ptrdiff_t rounded = 2;
+            while(rounded < capacity) rounded *= 2;
+            return rounded;
+        }
+
+    }
+
     /**
-    * Node for doubly linked list
+    * Bounded first in first out queue for one producer thread and one consumer thread, wait-free.
     * 
-    * @param value Value stored in the node
-    * @param next Pointer to next node
-    * @param prev Pointer to previous node
+    * Elements are stored in a ring buffer of a power of two capacity, positions are counters that only grow.
+    * The producer writes only tail and the consumer only head, each on its own cache line next to its copy
+    * of the other counter, which is reloaded only when the queue looks full or empty, so in a steady stream
+    * the threads rarely touch a shared cache line. Insert and Remove wait for space or for an element,
+    * so the queue replaces FIFO between two threads. Batch versions move many elements with one update
+    * of the counter.
+    *
+    * @tparam T the type of data stored in the structure, it must be default constructible.
     */
     template <typename T>
-    struct DoublyLLNode {
-        T value;
-        DoublyLLNode<T>* next;
-        DoublyLLNode<T>* prev;
-        DoublyLLNode(T v, DoublyLLNode<T>* n, DoublyLLNode<T>* p) {
-            value = v;
-            next = n;
-            prev = p;
-        }
+    class SPSCQueue {
+        public:
+            /**
+            * @param capacity number of elements, it is rounded up to a power of two.
+            */
+            SPSCQueue(ptrdiff_t capacity): tail(0), head_cache(0), head(0), tail_cache(0) {
+                this->capacity = Concurrent::RoundCapacity(capacity);
+                buf = new T[this->capacity];
+                ALGO_STAT(allocations, 1);
+            }
+
+            ~SPSCQueue() { delete[] buf; }
+
+            /**
+            * Inserts new element if the queue is not full, called by the producer.
+            * T(n) = O(1).
+            * S(n) = O(1).
+            *
+            * @param data element for insertion.
+            * @return false if the queue is full.
+            */
+            bool TryInsert(const T& data) { return Put(data); }
+
+            /**
+            * Moves new element into the queue if it is not full, called by the producer.
+            * T(n) = O(1).
+            * S(n) = O(1).
+            *
+            * @param data element for insertion, it is moved from only if it was inserted.
+            * @return false if the queue is full.
+            */
+            bool TryInsert(T&& data) { return Put(std::move(data)); }
+
+            /**
+            * Removes the oldest element if the queue is not empty, called by the consumer.
+            * T(n) = O(1).
+            * S(n) = O(1).
+            *
+            * @param data where the removed element is stored.
+            * @return false if the queue is empty.
+            */
+            bool TryRemove(T* data) {
+                ptrdiff_t h = head.load(std::memory_order_relaxed);
+                if(h == tail_cache) {
+                    tail_cache = tail.load(std::memory_order_acquire);
+                    if(h == tail_cache) return false;
+                }
+                *data = std::move(buf[h & (capacity - 1)]);
+                head.store(h + 1, std::memory_order_release);
+                return true;
+            }
+
+            /**
+            * Inserts new element, waits while the queue is full. Called by the producer.
+            * T(n) = O(1) if the queue is not full.
+            * S(n) = O(1).
+            *
+            * @param data element for insertion.
+            */
+            void Insert(const T& data) {
+                while(!TryInsert(data)) std::this_thread::yield();
+            }
+
+            /**
+            * Moves new element into the queue, waits while the queue is full. Called by the producer.
+            * T(n) = O(1) if the queue is not full.
+            * S(n) = O(1).
+            *
+            * @param data element for insertion, it is left in moved-from state.
+            */
+            void Insert(T&& data) {
+                while(!TryInsert(std::move(data))) std::this_thread::yield();
+            }
+
+            /**
+            * Removes the oldest element, waits while the queue is empty. Called by the consumer.
+            * T(n) = O(1) if the queue is not empty.
+            * S(n) = O(1).
+            *
+            * @return value data of the removed element.
+            */
+            T Remove() {
+                T value;
+                while(!TryRemove(&value)) std::this_thread::yield();
+                return value;
+            }
+
+            /**
+            * Inserts as many of len elements as fit, called by the producer.
+            * T(n) = O(len).
+            * S(n) = O(1).
+            *
+            * @param data elements for insertion.
+            * @param len number of elements.
+            * @return number of inserted elements, the first ones of data.
+            */
+            ptrdiff_t TryInsertBatch(const T* data, ptrdiff_t len) {
+                ptrdiff_t t = tail.load(std::memory_order_relaxed);
+                if(capacity - (t - head_cache) < len) head_cache = head.load(std::memory_order_acquire);
+                ptrdiff_t n = Min<ptrdiff_t>(len, capacity - (t - head_cache));
+                for(ptrdiff_t i=0; i<n; ++i) buf[(t + i) & (capacity - 1)] = data[i];
+                tail.store(t + n, std::memory_order_release);
+                return n;
+            }
+
+            /**
+            * Removes up to len oldest elements, called by the consumer.
+            * T(n) = O(len).
+            * S(n) = O(1).
+            *
+            * @param data where the removed elements are stored.
+            * @param len largest number of elements.
+            * @return number of removed elements.
+            */
+            ptrdiff_t TryRemoveBatch(T* data, ptrdiff_t len) {
+                ptrdiff_t h = head.load(std::memory_order_relaxed);
+                if(tail_cache - h < len) tail_cache = tail.load(std::memory_order_acquire);
+                ptrdiff_t n = Min<ptrdiff_t>(len, tail_cache - h);
+                for(ptrdiff_t i=0; i<n; ++i) data[i] = std::move(buf[(h + i) & (capacity - 1)]);
+                head.store(h + n, std::memory_order_release);
+                return n;
+            }
+
+            /**
+            * Inserts all len elements, waits while the queue is full. Called by the producer.
+            * T(n) = O(len) if there is space.
+            * S(n) = O(1).
+            */
+            void InsertBatch(const T* data, ptrdiff_t len) {
+                for(;;) {
+                    ptrdiff_t n = TryInsertBatch(data, len);
+                    data += n;
+                    len -= n;
+                    if(len == 0) return;
+                    std::this_thread::yield();
+                }
+            }
+
+            /**
+            * Removes exactly len elements, waits while the queue is empty. Called by the consumer.
+            * T(n) = O(len) if the elements are there.
+            * S(n) = O(1).
+            */
+            void RemoveBatch(T* data, ptrdiff_t len) {
+                for(;;) {
+                    ptrdiff_t n = TryRemoveBatch(data, len);
+                    data += n;
+                    len -= n;
+                    if(len == 0) return;
+                    std::this_thread::yield();
+                }
+            }
+
+            /**
+            * Returns true if the queue is empty, exact when called by the consumer.
+            * T(n) = O(1).
+            * S(n) = O(1).
+            */
+            bool IsEmpty() {
+                return head.load(std::memory_order_relaxed) == tail.load(std::memory_order_acquire);
+            }
+
+            /**
+            * Returns number of elements the queue holds.
+            * T(n) = O(1).
+            * S(n) = O(1).
+            */
+            ptrdiff_t Capacity() { return capacity; }
+
+        private:
+            // written by the producer
+            std::atomic<ptrdiff_t> tail;
+            ptrdiff_t head_cache;
+            char pad1[Concurrent::CACHE_LINE];
+            // written by the consumer
+            std::atomic<ptrdiff_t> head;
+            ptrdiff_t tail_cache;
+            char pad2[Concurrent::CACHE_LINE];
+            // read by both
+            T* buf;
+            ptrdiff_t capacity;
+
+            // inserts data copied or moved into the free slot
+            template <typename U>
+            bool Put(U&& data) {
+                ptrdiff_t t = tail.load(std::memory_order_relaxed);
+                if(t - head_cache == capacity) {
+                    head_cache = head.load(std::memory_order_acquire);
+                    if(t - head_cache == capacity) return false;
+                }
+                buf[t & (capacity - 1)] = std::forward<U>(data);
+                tail.store(t + 1, std::memory_order_release);
+                return true;
+            }
+
+            SPSCQueue(const SPSCQueue&);
+            SPSCQueue& operator=(const SPSCQueue&);
     };
     
     
     /**
-    * Doubly linked list with O(1) Inset, Append, Remove First and Remove Last.
+    * Bounded first in first out queue for any number of producer and consumer threads, lock-free.
     * 
-    * ...
+    * Every cell of the ring buffer has a sequence number, which tells the round of positions the cell is
+    * ready for: pos when it is free for the element at position pos and pos + 1 when that element is there.
+    * A thread claims a position by compare and swap of tail or head, then it fills or empties the cell
+    * and publishes it to the next round by its sequence number. Elements of one producer are removed
+    * in the order they were inserted.
     *
-    * @tparam T the type of data stored in the list.
+    * @tparam T the type of data stored in the structure, it must be default constructible.
     */
     template <typename T>
-    class DoublyLL { 
+    class MPMCQueue {
         public:
-            DoublyLLNode<T>* first;
-            DoublyLLNode<T>* last;
+            /**
+            * @param capacity number of elements, it is rounded up to a power of two.
+            */
+            MPMCQueue(ptrdiff_t capacity): tail(0), head(0) {
+                this->capacity = Concurrent::RoundCapacity(capacity);
+                cells = new Cell[this->capacity];
+                ALGO_STAT(allocations, 1);
+                for(ptrdiff_t i=0; i<this->capacity; ++i) cells[i].sequence.store(i, std::memory_order_relaxed);
+            }
 
-            DoublyLL(): first(NULL), last(NULL), length(0) {};
-            ~DoublyLL() { Clear(); }
+            ~MPMCQueue() { delete[] cells; }
 
             /**
-            * Inserts new element at the end of the list.
-            * T(n) = O(1).
+            * Inserts new element if the queue is not full.
+            * T(n) = O(1) without contention.
             * S(n) = O(1).
             *
             * @param data element for insertion.
+            * @return false if the queue is full.
             */
-            void Append(T data) {
-                DoublyLLNode<T>* node = new DoublyLLNode<T>(data, NULL, NULL);
-                if (length == 0) {
-                    first = node;
-                    last = node;
-                }
-                else {
-                    node->prev = last;
-                    last->next = node;
-                    last = node;
-                }
-                ++length;
-            }
-            
-            
+            bool TryInsert(const T& data) { return Put(data); }
+
             /**
-            * Inserts new element at the beginning of the list.
-            * T(n) = O(1).
+            * Moves new element into the queue if it is not full.
+            * T(n) = O(1), without contention.
             * S(n) = O(1).
             *
-            * @param data element for insertion.
+            * @param data element for insertion, it is moved from only if it was inserted.
+            * @return false if the queue is full.
             */
-            void Insert(T data) {
-                if (length == 0) append(data);
-                else {
-                    DoublyLLNode<T>* node = new DoublyLLNode<T>(data, first, NULL);
-                    first->prev = node;
-                    first = node; 
-                    ++length;
+            bool TryInsert(T&& data) { return Put(std::move(data)); }
+
+            /**
+            * Removes the oldest element if the queue is not empty.
+            * T(n) = O(1) without contention.
+            * S(n) = O(1).
+            *
+            * @param data where the removed element is stored.
+            * @return false if the queue is empty.
+            */
+            bool TryRemove(T* data) {
+                ptrdiff_t pos = head.load(std::memory_order_relaxed);
+                Cell* cell;
+                for(;;) {
+                    cell = &cells[pos & (capacity - 1)];
+                    ptrdiff_t diff = cell->sequence.load(std::memory_order_acquire) - (pos + 1);
+                    if(diff == 0) {
+                        if(head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+                    }
+                    // the element of this round was not inserted yet
+                    else if(diff < 0) return false;
+                    else pos = head.load(std::memory_order_relaxed);
                 }
+                *data = std::move(cell->data);
+                cell->sequence.store(pos + capacity, std::memory_order_release);
+                return true;
             }
-            
-            
+
             /**
-            * Removes last element from the list.
-            * T(n) = O(1).
+            * Inserts new element, waits while the queue is full.
+            * T(n) = O(1) if the queue is not full, without contention.
             * S(n) = O(1).
             *
-            * @return value data of removed element.
+            * @param data element for insertion.
             */
-            T RemoveLast() {
-                T returnValue = last->data;
-                T* temp = last;
-                last = last->prev;
-                last->next = NULL;
-                delete(temp);
-                --length;
-                return returnValue;
+            void Insert(const T& data) {
+                while(!TryInsert(data)) std::this_thread::yield();
             }
 
             /**
-            * Removes first element from the list.
-            * T(n) = O(1).
+            * Moves new element into the queue, waits while the queue is full.
+            * T(n) = O(1) if the queue is not full, without contention.
             * S(n) = O(1).
             *
-            * @return value data of removed element.
+            * @param data element for insertion, it is left in moved-from state.
             */
-            T RemoveFirst() {
-                T returnValue = first->value;
-                T* temp = first;
-                first = first-> next;
-                first->prev = NULL;
-                delete(temp);
-                --length;
-                return returnValue;
+            void Insert(T&& data) {
+                while(!TryInsert(std::move(data))) std::this_thread::yield();
             }
-            
+
             /**
-            * Removes all elements from list.
-            * T(n) = O(n) where n is the number of stored elements.
+            * Removes the oldest element, waits while the queue is empty.
+            * T(n) = O(1) if the queue is not empty, without contention.
             * S(n) = O(1).
             *
-            * @param data element for insertion.
+            * @return value data of the removed element.
             */
-
-            void Clear() {
-                while(first != NULL) RemoveFirst();
+            T Remove() {
+                T value;
+                while(!TryRemove(&value)) std::this_thread::yield();
+                return value;
             }
+
             /**
-            * Returns true if the structure is empty.
+            * Returns true if the queue is empty, other threads may change it right after.
             * T(n) = O(1).
             * S(n) = O(1).
             */
             bool IsEmpty() {
-                if(length == 0) return true;
-                else return false;
+                return head.load(std::memory_order_acquire) >= tail.load(std::memory_order_acquire);
             }
 
             /**
-            * Returns length of the list.
+            * Returns number of elements the queue holds.
             * T(n) = O(1).
             * S(n) = O(1).
             */
-            int Length() {
-                return length;
-            }
+            ptrdiff_t Capacity() { return capacity; }
 
         private:
-            int length;
+            struct Cell {
+                std::atomic<ptrdiff_t> sequence;
+                T data;
+            };
 
+            // written by producers
+            std::atomic<ptrdiff_t> tail;
+            char pad1[Concurrent::CACHE_LINE];
+            // written by consumers
+            std::atomic<ptrdiff_t> head;
+            char pad2[Concurrent::CACHE_LINE];
+            // read by all
+            Cell* cells;
+            ptrdiff_t capacity;
+
+            // claims the cell at the tail and stores data copied or moved into it
+            template <typename U>
+            bool Put(U&& data) {
+                ptrdiff_t pos = tail.load(std::memory_order_relaxed);
+                Cell* cell;
+                for(;;) {
+                    cell = &cells[pos & (capacity - 1)];
+                    ptrdiff_t diff = cell->sequence.load(std::memory_order_acquire) - pos;
+                    if(diff == 0) {
+                        if(tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+                    }
+                    // the cell still holds the element of the previous round
+                    else if(diff < 0) return false;
+                    else pos = tail.load(std::memory_order_relaxed);
+                }
+                cell->data = std::forward<U>(data);
+                cell->sequence.store(pos + 1, std::memory_order_release);
+                return true;
+            }
+
+            MPMCQueue(const MPMCQueue&);
+            MPMCQueue& operator=(const MPMCQueue&);
     };
 
+
+    // Hazard pointers used by lock-free structures to free removed nodes safely.
+    namespace Concurrent {
+
+        // Removed nodes of a thread are freed when it has this many more of them than there are hazard records.
+        const int RETIRE_BATCH = 64;
+
+        /**
+        * Node removed from a structure, which is freed by free(node) once no thread protects it.
+        */
+        struct Retired {
+            void* node;
+            void (*free)(void* node);
+        };
+
+        /**
+        * Hazard pointer of one thread and nodes it removed. Records are linked in a global list and never freed,
+        * a thread takes a free one on its first use of a lock-free structure and returns it when it exits,
+        * together with the removed nodes still protected by other threads.
+        */
+        struct HazardRecord {
+            std::atomic<void*> hazard;
+            std::atomic<bool> active;
+            HazardRecord* next;
+            Retired* retired;
+            ptrdiff_t retired_len;
+            ptrdiff_t retired_capacity;
+            char pad[CACHE_LINE];
+        };
+
+        inline std::atomic<HazardRecord*>& HazardRecords() {
+            static std::atomic<HazardRecord*> records(NULL);
+            return records;
+        }
+
+        inline std::atomic<ptrdiff_t>& HazardRecordCount() {
+            static std::atomic<ptrdiff_t> count(0);
+            return count;
+        }
+
+        /**
+        * Frees removed nodes of record that are not protected by any hazard pointer.
+        */
+        inline void Scan(HazardRecord* record) {
+            // records registered during the walk are prepended, so the whole list is walked and the array grows
+            ptrdiff_t capacity = Max<ptrdiff_t>(HazardRecordCount().load(std::memory_order_acquire), 16);
+            uintptr_t* hazards = new uintptr_t[capacity];
+            ptrdiff_t hazards_len = 0;
+            for(HazardRecord* r = HazardRecords().load(std::memory_order_acquire); r != NULL; r = r->next) {
+                void* hazard = r->hazard.load(std::memory_order_seq_cst);
+                if(hazard == NULL) continue;
+                if(hazards_len == capacity) {
+                    uintptr_t* grown = new uintptr_t[2 * capacity];
+                    memcpy(grown, hazards, capacity * sizeof(uintptr_t));
+                    delete[] hazards;
+                    hazards = grown;
+                    capacity *= 2;
+                }
+                hazards[hazards_len++] = (uintptr_t)hazard;
+            }
+            ArrSort<uintptr_t>(hazards, hazards_len);
+            ptrdiff_t kept = 0;
+            for(ptrdiff_t i=0; i<record->retired_len; ++i) {
+                Retired retired = record->retired[i];
+                ptrdiff_t idx = LowerBound<uintptr_t>(hazards, hazards_len, (uintptr_t)retired.node);
+                if(idx < hazards_len && hazards[idx] == (uintptr_t)retired.node) record->retired[kept++] = retired;
+                else retired.free(retired.node);
+            }
+            record->retired_len = kept;
+            delete[] hazards;
+        }
+
+        /**
+        * Record of the calling thread, held from its first use until the thread exits.
+        */
+        struct ThreadHazard {
+            HazardRecord* record;
+
+            ThreadHazard() {
+                for(record = HazardRecords().load(std::memory_order_acquire); record != NULL; record = record->next) {
+                    bool inactive = false;
+                    if(!record->active.load(std::memory_order_relaxed) && record->active.compare_exchange_strong(inactive, true)) return;
+                }
+                record = new HazardRecord();
+                record->hazard.store(NULL, std::memory_order_relaxed);
+                record->active.store(true, std::memory_order_relaxed);
+                record->retired = NULL;
+                record->retired_len = 0;
+                record->retired_capacity = 0;
+                HazardRecordCount().fetch_add(1);
+                HazardRecord* head = HazardRecords().load(std::memory_order_relaxed);
+                do record->next = head;
+                while(!HazardRecords().compare_exchange_weak(head, record));
+            }
+
+            ~ThreadHazard() {
+                record->hazard.store(NULL, std::memory_order_release);
+                Scan(record);
+                record->active.store(false, std::memory_order_release);
+            }
+        };
+
+        inline HazardRecord* ThreadHazardRecord() {
+            static thread_local ThreadHazard thread_hazard;
+            return thread_hazard.record;
+        }
+
+        template <typename Node>
+        void DeleteNode(void* node) { delete (Node*)node; }
+
+        /**
+        * Hands node removed by the calling thread over to be freed once no thread protects it.
+        */
+        inline void Retire(HazardRecord* record, void* node, void (*free)(void*)) {
+            if(record->retired_len == record->retired_capacity) {
+                ptrdiff_t new_capacity = Max<ptrdiff_t>(2 * record->retired_capacity, RETIRE_BATCH);
+                Retired* retired = new Retired[new_capacity];
+                for(ptrdiff_t i=0; i<record->retired_len; ++i) retired[i] = record->retired[i];
+                delete[] record->retired;
+                record->retired = retired;
+                record->retired_capacity = new_capacity;
+            }
+            Retired retired = {node, free};
+            record->retired[record->retired_len++] = retired;
+            if(record->retired_len >= RETIRE_BATCH + 2 * HazardRecordCount().load(std::memory_order_relaxed)) Scan(record);
+        }
+
+    }
+
     /**
-    * First in first out data structure with O(1) Delete and Insert.
+    * Last in first out storage for any number of threads, lock-free (Treiber stack).
     * 
-    * ...
+    * Elements are in a linked list, whose first node is replaced by compare and swap. A removing thread
+    * protects the first node by its hazard pointer before it reads it, so the node is not freed and its
+    * address is not reused by another node while the thread works with it, which also prevents the ABA
+    * problem. Removed nodes are freed in batches of those no hazard pointer points to.
     *
-    * @tparam T the type of data stored in the structure.
+    * @tparam T the type of data stored in the structure, it must be default constructible.
     */
     template <typename T>
-    class FIFO: protected SinglyLL<T> {
-        public: 
-            FIFO() {};
-            
+    class ConcurrentLIFO {
+        public:
+            ConcurrentLIFO(): top(NULL) {}
+
+            ~ConcurrentLIFO() {
+                Node* node = top.load(std::memory_order_relaxed);
+                while(node != NULL) {
+                    Node* next = node->next;
+                    delete node;
+                    node = next;
+                }
+            }
+
             /**
             * Inserts new element into structure.
-            * T(n) = O(1).
+            * T(n) = O(1) without contention.
             * S(n) = O(1).
             *
             * @param data element for insertion.
             */
-            void Insert(T data) { SinglyLL<T>::Insert(data); }
-            
+            void Insert(const T& data) { Emplace(data); }
+
             /**
-            * Removes the element, that has been in the structure for the longest time.
-            * T(n) = O(1).
+            * Moves new element into structure.
+            * T(n) = O(1) without contention.
             * S(n) = O(1).
             *
-            * @return value data of the removed element.
+            * @param data element for insertion, it is left in moved-from state.
             */
-            T Remove() { return SinglyLL<T>::RemoveFirst(); }
-            
+            void Insert(T&& data) { Emplace(std::move(data)); }
+
             /**
-            * Returns true if the structure is empty.
-            * T(n) = O(1).
+            * Constructs new element in place in its node.
+            * T(n) = O(1) without contention.
             * S(n) = O(1).
+            *
+            * @param args arguments of the constructor of T.
             */
-            bool IsEmpty() { SinglyLL<T>::IsEmpty(); }
-    };
-    
-    
-    /**
-    * Last in first out storage for data with O(1) Delete and Insert.
-    * 
-    * ...
-    *
-    * @tparam T the type of data stored in the structure.
-    */
-    template <typename T>
-    class LIFO: protected SinglyLL<T> {
-        public: 
-            LIFO() {};    
-        
+            template <typename... Args>
+            void Emplace(Args&&... args) {
+                Node* node = new Node(std::forward<Args>(args)...);
+                ALGO_STAT(allocations, 1);
+                node->next = top.load(std::memory_order_relaxed);
+                while(!top.compare_exchange_weak(node->next, node, std::memory_order_release, std::memory_order_relaxed));
+            }
+
             /**
-            * Inserts new element into structure.
-            * T(n) = O(1).
+            * Removes the element inserted last if the structure is not empty.
+            * T(n) = O(1) amortized, without contention.
             * S(n) = O(1).
             *
-            * @param data element for insertion.
+            * @param data where the removed element is stored.
+            * @return false if the structure is empty.
             */
-            void Insert(T data) { SinglyLL<T>::Append(data); }
+            bool TryRemove(T* data) {
+                Concurrent::HazardRecord* record = Concurrent::ThreadHazardRecord();
+                Node* node = top.load(std::memory_order_acquire);
+                for(;;) {
+                    if(node == NULL) return false;
+                    // the node is protected only if it is still on the top after the hazard pointer is visible
+                    record->hazard.store(node, std::memory_order_seq_cst);
+                    Node* current = top.load(std::memory_order_seq_cst);
+                    if(current != node) {
+                        node = current;
+                        continue;
+                    }
+                    if(top.compare_exchange_strong(node, node->next, std::memory_order_acquire, std::memory_order_acquire)) break;
+                }
+                // only the thread that popped the node reads its value
+                *data = std::move(node->value);
+                record->hazard.store(NULL, std::memory_order_release);
+                Concurrent::Retire(record, node, Concurrent::DeleteNode<Node>);
+                return true;
+            }
 
             /**
-            * Removes the element, that has been in the structure for the shortest time.
-            * T(n) = O(1).
+            * Removes the element inserted last, waits while the structure is empty.
+            * T(n) = O(1) amortized, if the structure is not empty.
             * S(n) = O(1).
             *
             * @return value data of the removed element.
             */
-            T Remove() { return SinglyLL<T>::RemoveFirst(); }
-     
+            T Remove() {
+                T value;
+                while(!TryRemove(&value)) std::this_thread::yield();
+                return value;
+            }
+
             /**
-            * Returns true if the structure is empty.
+            * Returns true if the structure is empty, other threads may change it right after.
             * T(n) = O(1).
             * S(n) = O(1).
             */
-            bool IsEmpty() { SinglyLL<T>::IsEmpty(); }
+            bool IsEmpty() { return top.load(std::memory_order_acquire) == NULL; }
+
+        private:
+            struct Node {
+                T value;
+                Node* next;
+                template <typename... Args>
+                Node(Args&&... args): value(std::forward<Args>(args)...), next(NULL) {}
+            };
+
+            std::atomic<Node*> top;
+
+            ConcurrentLIFO(const ConcurrentLIFO&);
+            ConcurrentLIFO& operator=(const ConcurrentLIFO&);
     };
     
     
@@ -626,7 +5619,7 @@ namespace algo {
     * Node for AVL trees
     * 
     * @param data data stored in node
-    * @param balance height(left) - height(right)
+    * @param balance height(right) - height(left)
     * @param height 0 for Node with no child, max(height(left), height(right)) + 1 otherwise
     * @left pointer to left child node
     * @right pointer to right child node
@@ -638,13 +5631,8 @@ namespace algo {
         int height;
         AVLTreeNode<T>* left;
         AVLTreeNode<T>* right;
-        AVLTreeNode(T d, int b, int h, AVLTreeNode<T>* l, AVLTreeNode<T>* r) {
-            data = d;
-            balance = b;
-            height = h;
-            left =l;
-            right = r;
-        }
+        template <typename U>
+        AVLTreeNode(U&& d, int b, int h, AVLTreeNode<T>* l, AVLTreeNode<T>* r): data(std::forward<U>(d)), balance(b), height(h), left(l), right(r) {}
         AVLTreeNode(int h) {
             height = h;
         }
@@ -657,11 +5645,12 @@ namespace algo {
     * ...
     *
     * @tparam T the type of data stored in the tree. T must be totally ordered and it must have defined >,<,= operators.
+    * @tparam Alloc allocator of the nodes, NewAllocator, PoolAllocator or ArenaAllocator.
     */
-    template <typename T>
+    template <typename T, typename Alloc = NewAllocator>
     class AVLTree {
         public:
-            AVLTree(): size(0) {
+            AVLTree(Alloc alloc = Alloc()): size(0), alloc(alloc) {
                     end = new AVLTreeNode<T>(-1);
                     root = end;
                 }
@@ -679,9 +5668,20 @@ namespace algo {
             *
             * @param data element for insertion.
             */
-            void Insert(T data) {
-                if(size == 0) root = new AVLTreeNode<T>(data, 0, 0, end, end);
-                else Insert(data, root, &root);
+            void Insert(const T& data) {
+                Insert(data, &root);
+                ++size;
+            }
+
+            /**
+            * Moves new element into AVL tree.
+            * T(n) = O(log(n)), where n is the number of elements in tree.
+            * S(n) = O(1).
+            *
+            * @param data element for insertion, it is left in moved-from state.
+            */
+            void Insert(T&& data) {
+                Insert(std::move(data), &root);
                 ++size;
             }
 
@@ -691,11 +5691,9 @@ namespace algo {
             * S(n) = O(1).
             *
             * @param data element which will be removed.
-            // TODO 
             */
-            void Remove(T data) {
-               Remove(data, root, &root);
-               --size;
+            void Remove(const T& data) {
+               if(Remove(data, &root)) --size;
             }
 
             /**
@@ -706,7 +5704,7 @@ namespace algo {
             * @param data element being search.
             * @return value Is the element in the AVL tree?
             */
-            bool Find(T data) {
+            bool Find(const T& data) {
                 return Find(data, root);
             }
 
@@ -716,181 +5714,126 @@ namespace algo {
             * S(n) = O(1).
             */
             void Clear() {
-                Clear(root);
+                if(!Memory::ReleasesAll<T, Alloc>::value) Clear(root);
+                alloc.Release();
+                root = end;
+                size = 0;
+            }
+
+            /**
+            * Returns height of the tree and its rebalancing stats, which stay zero unless ALGO_STATS is defined.
+            * T(n) = O(1).
+            * S(n) = O(1).
+            */
+            TreeStats GetStats() {
+#ifdef ALGO_STATS
+                TreeStats result = stats;
+#else
+                TreeStats result = TreeStats();
+#endif
+                result.height = root->height + 1;
+                return result;
             }
 
         protected:
             AVLTreeNode<T>* root;
             AVLTreeNode<T>* end;
             int size;
+            Alloc alloc;
+#ifdef ALGO_STATS
+            TreeStats stats = TreeStats();
+#endif
+
+        private:
+            AVLTree(const AVLTree&);
+            AVLTree& operator=(const AVLTree&);
             
             
-            bool Find(T data, AVLTreeNode<T>* node) {
+            bool Find(const T& data, AVLTreeNode<T>* node) {
                 if (node == end) return false;
                 else if (node->data == data) return true;
                 else if (node->data > data) return Find(data, node->left);
                 else return Find(data, node->right);
             }
 
-            int Insert(T data, AVLTreeNode<T>* node, AVLTreeNode<T>** parent_pointer) {
-                if(node->data > data) {
-                    if(node->left == end) {
-                        node->left = new AVLTreeNode<T>(data, 0, 0, end, end);
-                        --node->balance;
-                        node->height = 1;
-                        return 1;
-                    }
-                    else {
-                        int temp = Insert(data, node->left, &(node->left));
-                        if(temp == 0) return 0;
-                        switch(node->balance) {
-                            case -1:
-                                if (node->left->balance == -1) {
-                                    *parent_pointer = RotateRight(node);
-                                    return 0;
-                                }
-                                else {
-                                    *parent_pointer = DoubleRotateLeft(node); 
-                                    return 0;
-                                }
-                                break;
-                            case 0:
-                                node->balance = -1;
-                                ++(node->height);
-                                return 1;
-                            case 1:
-                                node->balance = 0;
-                                return 0;
-                        }
-                    }
-                }
-                else {
-                    if(node->right == end) {
-                        node->right = new AVLTreeNode<T>(data, 0, 0, end, end); 
-                        ++node->balance;
-                        node->height = 1;
-                        return 1;
-                    }
-                    else {
-                        int temp = Insert(data, node->right, &(node->right));
-                        if(temp == 0) return 0;
-                        switch(node->balance) {
-                            case 1:
-                                if (node->right->balance == 1) {
-                                    *parent_pointer = RotateLeft(node);
-                                    return 0;
-                                }
-                                else {
-                                    *parent_pointer = DoubleRotateLeft(node); 
-                                    return 0;
-                                }
-                            case 0:
-                                node->balance = 1;
-                                ++(node->height);
-                                return 1;
-                            case -1:
-                                node->balance = 0;
-                                return 0;
-                        }
-                    }
+            // data is passed down by reference and copied or moved only into the new leaf
+            template <typename U>
+            void Insert(U&& data, AVLTreeNode<T>** parent_pointer) {
+                AVLTreeNode<T>* node = *parent_pointer;
+                if(node == end) {
+                    *parent_pointer = new(alloc.Allocate(sizeof(AVLTreeNode<T>))) AVLTreeNode<T>(std::forward<U>(data), 0, 0, end, end);
+                    return;
                 }
-                return 0;
+                if(node->data > data) Insert(std::forward<U>(data), &(node->left));
+                else Insert(std::forward<U>(data), &(node->right));
+                *parent_pointer = Rebalance(node);
             }
 
-
-            int Remove(T data, AVLTreeNode<T>* node, AVLTreeNode<T>** parent_pointer) {
-                // if this node is supposed to be removed, remove the node
+            bool Remove(const T& data, AVLTreeNode<T>** parent_pointer) {
+                AVLTreeNode<T>* node = *parent_pointer;
+                if(node == end) return false;
+                bool removed = true;
                 if(node->data == data) {
-                    if(node->left == end) {
-                        if(node->right == end) {
-                            *parent_pointer = end;
-                            delete node;
-                            return -1;
-                        }
-                        else {
-                            *parent_pointer = node->right;
-                            delete node;
-                            return -1;
-                        }
-                    }
-                    else {
-                        if(node->right == end) {
-                            *parent_pointer = node->left;
-                            delete node;
-                            return -1;
-                        }
-                        // if the node has both child, we need to find replacement first
-                        else {
-                            AVLTreeNode<T>* temp = node->right;
-                            while(temp->left != end) temp = temp->left;
-                            node->data = temp->data;
-                            data = temp->data;
-                        }
+                    // node with at most one child is replaced by it
+                    if(node->left == end || node->right == end) {
+                        *parent_pointer = (node->left == end)? node->right: node->left;
+                        Memory::Delete(alloc, node);
+                        return true;
                     }
+                    // otherwise its successor is unlinked from the right subtree and its data is moved here
+                    AVLTreeNode<T>* successor = RemoveMin(&(node->right));
+                    node->data = std::move(successor->data);
+                    Memory::Delete(alloc, successor);
                 }
-                // if data is in any child we call remove on child and then handle rebalancing
-                else if (node->data > data) {
-                    int temp = Remove(data, node->left, &(node->left));
-                    if(temp == 0) return 0;
-                    switch(node->balance) {
-                        case -1:
-                            node->balance = 0;
-                            --node->height;
-                            return -1;
-                        case 0:
-                            node->balance = 1;
-                            return 0;
-                        case 1:
-                            switch (node->right->balance) {
-                                case -1:
-                                    *parent_pointer = DoubleRotateLeft(node);
-                                    return -1;
-                                case 0:
-                                    *parent_pointer = RotateLeft(node);
-                                    return 0;
-                                case 1:
-                                    *parent_pointer = RotateLeft(node);
-                                    return -1;
-                            }
-                    }
+                else if(node->data > data) removed = Remove(data, &(node->left));
+                else removed = Remove(data, &(node->right));
+                *parent_pointer = Rebalance(node);
+                return removed;
+            }
+
+            /**
+            * Unlinks the leftmost node of a nonempty subtree and rebalances the path to it,
+            * returns the unlinked node.
+            */
+            AVLTreeNode<T>* RemoveMin(AVLTreeNode<T>** parent_pointer) {
+                AVLTreeNode<T>* node = *parent_pointer;
+                if(node->left == end) {
+                    *parent_pointer = node->right;
+                    return node;
                 }
-                else {
-                    int temp = Remove(data, node->right, &(node->right));
-                    if(temp == 0) return 0;
-                    switch(node->balance) {
-                        case 1:
-                            node->balance = 0;
-                            --node->height;
-                            return -1;
-                        case 0:
-                            node->balance = 1;
-                            return 0;
-                        case -1:
-                            switch (node->left->balance) {
-                                case 1:
-                                    *parent_pointer = DoubleRotateRight(node);
-                                    return -1;
-                                case 0:
-                                    *parent_pointer = RotateRight(node);
-                                    return 0;
-                                case -1:
-                                    *parent_pointer = RotateRight(node);
-                                    return -1;
-                            }
-                    }
+                AVLTreeNode<T>* min = RemoveMin(&(node->left));
+                *parent_pointer = Rebalance(node);
+                return min;
+            }
+
+            /**
+            * Updates height and balance of node from its children and restores the balance by rotations,
+            * returns the new root of the subtree.
+            */
+            AVLTreeNode<T>* Rebalance(AVLTreeNode<T>* node) {
+                node->height = Max<int>(node->left->height, node->right->height) + 1;
+                node->balance = node->right->height - node->left->height;
+                if(node->balance > 1) {
+                    if(node->right->balance < 0) return DoubleRotateLeft(node);
+                    return RotateLeft(node);
+                }
+                if(node->balance < -1) {
+                    if(node->left->balance > 0) return DoubleRotateRight(node);
+                    return RotateRight(node);
                 }
-                return 0;
+                return node;
             }
             
             void Clear(AVLTreeNode<T>* node) {
                 if(node != end) {
                     Clear(node->left);
                     Clear(node->right);
-                    delete node;
+                    Memory::Delete(alloc, node);
                 }
             }
 
             AVLTreeNode<T>* RotateLeft(AVLTreeNode<T>* x) {
+                ALGO_TREE_STAT(rotations, 1);
                 AVLTreeNode<T>* y = x->right;
                 AVLTreeNode<T>* t = y->left;
                 y->left = x;
@@ -903,6 +5846,7 @@ namespace algo {
             }
 
             AVLTreeNode<T>* RotateRight(AVLTreeNode<T>* y) {
+                ALGO_TREE_STAT(rotations, 1);
                 AVLTreeNode<T>* x = y->left;
                 AVLTreeNode<T>* t = x->right;
                 x->right = y;
@@ -921,15 +5865,15 @@ namespace algo {
             }
 
             AVLTreeNode<T>* DoubleRotateLeft(AVLTreeNode<T>* x) {
-                x->left = RotateLeft(x->left);
-                return RotateRight(x);
+                x->right = RotateRight(x->right);
+                return RotateLeft(x);
             } 
     };
    
 
 
 
-    template <typename T>
+    template <typename T, typename Alloc>
     class ABTreeNode;
     
     
@@ -940,57 +5884,56 @@ namespace algo {
     * @param next Pointer to next knot)
     * @param child Pointer to child node, all keys stored there are smaller than key
     */
-    template<typename T>
+    template<typename T, typename Alloc>
     struct ABTreeKnot{
         T key;
-        ABTreeKnot<T>* next;
-        ABTreeNode<T>* child;
-        ABTreeKnot(T k, ABTreeKnot<T>* n, ABTreeNode<T>* c) {
-            key = k;
-            next = n;
-            child = c;
-        }
-        ABTreeKnot(ABTreeNode<T>* c) {
+        ABTreeKnot<T, Alloc>* next;
+        ABTreeNode<T, Alloc>* child;
+        template <typename U>
+        ABTreeKnot(U&& k, ABTreeKnot<T, Alloc>* n, ABTreeNode<T, Alloc>* c): key(std::forward<U>(k)), next(n), child(c) {}
+        ABTreeKnot(ABTreeNode<T, Alloc>* c) {
             next = NULL;
             child = c;
         }
     };
     
     /**
-    * Node for AB trees
+    * Node for AB trees, its nodes and knots are allocated by alloc of the tree.
     */
-    template <typename T>
+    template <typename T, typename Alloc>
     class ABTreeNode {
         public:
             // constructor for creating root node;
-            ABTreeNode(): key_count(0), last_layer(false), parent_node(NULL) {
-                list = new ABTreeKnot<T>(NULL);
+            ABTreeNode(Alloc* a): key_count(0), last_layer(false), parent_node(NULL), alloc(a) {
+                list = NewKnot(NULL);
             }
             
             // constructor for creating first no-root node
-            ABTreeNode(bool l):  key_count(0), last_layer(l) {
-                list = new ABTreeKnot<T>(NULL);
+            ABTreeNode(Alloc* a, bool l):  key_count(0), last_layer(l), alloc(a) {
+                list = NewKnot(NULL);
             }
             
             // constructor for 
-            ABTreeNode(ABTreeNode<T>* n, ABTreeKnot<T>* k): key_count(0), last_layer(true), parent_node(n), parent_knot(k) {
-                list = new ABTreeKnot<T>(NULL);
+            ABTreeNode(Alloc* a, ABTreeNode<T, Alloc>* n, ABTreeKnot<T, Alloc>* k): key_count(0), last_layer(true), parent_node(n), parent_knot(k), alloc(a) {
+                list = NewKnot(NULL);
             }
             
             // constructor for creating node with data, used when splitting/merging
-            ABTreeNode(int k, bool l, ABTreeNode<T>* p, ABTreeKnot<T>* li):
-                key_count(k), last_layer(l), parent_node(p), list(li), parent_knot(NULL) {}
+            ABTreeNode(Alloc* a, int k, bool l, ABTreeNode<T, Alloc>* p, ABTreeKnot<T, Alloc>* li):
+                key_count(k), last_layer(l), parent_node(p), list(li), parent_knot(NULL), alloc(a) {
+            }
            
             
             /**
             * Tries to insert data into node.
             * At success returns NULL
-            * If it fails return pointer to child that leads the right way
+            * If it fails return pointer to child that leads the right way, data is not moved from then
             */
-            ABTreeNode<T>* Insert(T data) {
+            template <typename U>
+            ABTreeNode<T, Alloc>* Insert(U&& data) {
                 // inserting into empty tree
                 if(list->next == NULL) {
-                    list = new ABTreeKnot<T>(data, list, NULL);
+                    list = NewKnot(std::forward<U>(data), list, NULL);
                     ++key_count;
                     return NULL;
                 }
@@ -998,24 +5941,24 @@ namespace algo {
                 // if this is the lowest level, we will be inserting here
                 if(last_layer) {
                     ++key_count;
-                    if(data < list->key) list = new ABTreeKnot<T>(data, list, NULL); 
+                    if(data < list->key) list = NewKnot(std::forward<U>(data), list, NULL); 
                     else {
-                        ABTreeKnot<T>* pt = list;
+                        ABTreeKnot<T, Alloc>* pt = list;
                         while(pt->next->next != NULL) {
                             if(data < pt->next->key) { 
-                                pt->next = new ABTreeKnot<T>(data, pt->next, NULL);
+                                pt->next = NewKnot(std::forward<U>(data), pt->next, NULL);
                                 return NULL;
                             }
                             pt = pt->next;
                         }
-                        pt->next = new ABTreeKnot<T>(data, pt->next, NULL);
+                        pt->next = NewKnot(std::forward<U>(data), pt->next, NULL);
                     }
                     return NULL;
                 }
                 
                 // if its not the lowest level, find the right child
                 else {
-                    ABTreeKnot<T>* pt = list;
+                    ABTreeKnot<T, Alloc>* pt = list;
                     while(pt->next != NULL) {
                         if(data < pt->key) return pt->child;
                         pt = pt->next;
@@ -1031,25 +5974,25 @@ namespace algo {
             */
             void Split() {
                 // make new node with second half of knots
-                ABTreeKnot<T>* pt = list;
+                ABTreeKnot<T, Alloc>* pt = list;
                 for(int i=0; i<key_count/2; ++i) pt = pt->next;
-                ABTreeNode<T>* new_node = new ABTreeNode<T>(((key_count-1)/2), last_layer, parent_node, pt->next);
+                ABTreeNode<T, Alloc>* new_node = new(alloc->Allocate(sizeof(ABTreeNode<T, Alloc>))) ABTreeNode<T, Alloc>(alloc, ((key_count-1)/2), last_layer, parent_node, pt->next);
                 
                 // set this new node as parent for her child
                 if(!last_layer) {
-                    ABTreeKnot<T>* pt2 = pt->next;
+                    ABTreeKnot<T, Alloc>* pt2 = pt->next;
                     while(pt2 != NULL) {
                         pt2->child->SetParentNode(new_node);
                         pt2 = pt2->next;
                     }
                 }
              
-                // removing end pointer of first half
-                T new_key = pt->key;
+                // removing end pointer of first half, key of the end knot is not used
+                T new_key = std::move(pt->key);
                 pt->next = NULL;
 
                 // join split nodes into corresponding knots
-                parent_node->SplitChild(parent_knot, new_node, new_key);
+                parent_node->SplitChild(parent_knot, new_node, std::move(new_key));
 
                 // updating key_count
                 key_count = key_count/2; 
@@ -1069,8 +6012,8 @@ namespace algo {
                         parent_node->GetList()->child = list->child;
                         list->child->SetParentNode(parent_node);
                         list->child->SetParentKnot(NULL);
-                        delete list;
-                        delete this;
+                        Memory::Delete(*alloc, list);
+                        Memory::Delete(*alloc, this);
                     }
                     else return;
                 }
@@ -1079,18 +6022,18 @@ namespace algo {
                     // Try using left brother
                     if(parent_knot->next != NULL) {
                         // find last knot
-                        ABTreeKnot<T>* end = list;
+                        ABTreeKnot<T, Alloc>* end = list;
                         while(end->next != NULL) end = end->next;
 
                         //find brother
-                        ABTreeNode<T>* brother = parent_knot->next->child;
+                        ABTreeNode<T, Alloc>* brother = parent_knot->next->child;
 
                         // if brother has >a knots, just steal one
                         if(brother->GetKeyCount() > a) {
                             
-                            // move keys
-                            end->key = parent_knot->key;
-                            parent_knot->key = brother->GetList()->key;
+                            // move keys, the stolen knot becomes the end knot
+                            end->key = std::move(parent_knot->key);
+                            parent_knot->key = std::move(brother->GetList()->key);
                             
                             // steal knot from brother
                             end->next = brother->GetList();
@@ -1099,8 +6042,8 @@ namespace algo {
                             
                             // if not on last layer, update parent info in new knot
                             if(!last_layer) {
-                                end->next->child->SetParentNode(parent_node);
-                                end->next->child->SetParentKnot(parent_knot);
+                                end->next->child->SetParentNode(this);
+                                end->next->child->SetParentKnot(end->next);
                             }
                             
                             //update key counts
@@ -1111,15 +6054,14 @@ namespace algo {
                         // if brother has exactly a knots, merge him into this node
                         else {
                             // connect brothers knots
-                            end->key = parent_knot->key;
+                            end->key = std::move(parent_knot->key);
                             end->next = brother->GetList();
 
                             // if not on last layer set new parent knot and node to moved knots
                             if(!last_layer) {
-                                ABTreeKnot<T>* pt  = brother->GetList();
+                                ABTreeKnot<T, Alloc>* pt  = brother->GetList();
                                 while(pt != NULL){
-                                    pt->child->SetParentKnot(parent_knot);
-                                    pt->child->SetParentNode(parent_node);
+                                    pt->child->SetParentNode(this);
                                     pt = pt->next;
                                 }
                             }
@@ -1130,44 +6072,44 @@ namespace algo {
                             
                             // delete brother
                             brother->SetList(NULL);
-                            delete brother;
+                            Memory::Delete(*alloc, brother);
                             
                             // remove brothers knot in parent node
-                            parent_knot->key = parent_knot->next->key;
-                            ABTreeKnot<T>* del = parent_knot->next;
+                            parent_knot->key = std::move(parent_knot->next->key);
+                            ABTreeKnot<T, Alloc>* del = parent_knot->next;
                             parent_knot->next = parent_knot->next->next;
-                            delete del;
+                            Memory::Delete(*alloc, del);
                         }
                     }
 
                     // Use left brother
                     else {
                         // find brother
-                        ABTreeKnot<T>* prev = parent_node->FindPrev(parent_knot);
-                        ABTreeNode<T>* brother = prev->child;
+                        ABTreeKnot<T, Alloc>* prev = parent_node->FindPrev(parent_knot);
+                        ABTreeNode<T, Alloc>* brother = prev->child;
                         
                         
                         // if brother has >a knots, just steal one
                         if(brother->GetKeyCount() > a) {
                             // find brothers last knot
-                            ABTreeKnot<T>* pt = brother->GetList();
+                            ABTreeKnot<T, Alloc>* pt = brother->GetList();
                             while(pt->next->next != NULL) pt = pt->next;
-                            ABTreeKnot<T>* brother_end = pt->next;
+                            ABTreeKnot<T, Alloc>* brother_end = pt->next;
 
                             // steal knot
                             pt->next = NULL;
                             brother_end->next = list;
                             list = brother_end;
                             
-                            //move keys
-                            brother_end->key = prev->key;
-                            prev->key = pt->key;
+                            //move keys, pt became the end knot of brother
+                            brother_end->key = std::move(prev->key);
+                            prev->key = std::move(pt->key);
 
                             
                             // if not on last layer, update parent info in new knot
                             if(!last_layer) {
-                                list->child->SetParentKnot(parent_knot);
-                                list->child->SetParentNode(parent_node);
+                                list->child->SetParentKnot(list);
+                                list->child->SetParentNode(this);
                             }
 
                             // update key count
@@ -1177,18 +6119,18 @@ namespace algo {
                         // merge this node into brother
                         else {
                             // find last knot of brother 
-                            ABTreeKnot<T>* brother_end = brother->GetList();
+                            ABTreeKnot<T, Alloc>* brother_end = brother->GetList();
                             while(brother_end->next != NULL) brother_end = brother_end->next;
                             
                             // join nodes 
-                            brother_end->key = prev->key;
+                            brother_end->key = std::move(prev->key);
                             brother_end->next = list;
-                            prev->key = parent_knot->key;
+                            prev->key = std::move(parent_knot->key);
                             prev->next = parent_knot->next;
                              
                             // if not on last layer set new parent knot and node to moved knots
                             if(!last_layer) {
-                                ABTreeKnot<T>* pt  = list;
+                                ABTreeKnot<T, Alloc>* pt  = list;
                                 while(pt != NULL){
                                     pt->child->SetParentNode(brother);
                                     pt = pt->next;
@@ -1199,9 +6141,9 @@ namespace algo {
                             brother->SetKeyCount(brother->GetKeyCount() + key_count + 1);
                             parent_node->SetKeyCount(parent_node->GetKeyCount() - 1);
                             
-                            delete parent_knot;
+                            Memory::Delete(*alloc, parent_knot);
                             list = NULL;
-                            delete this;
+                            Memory::Delete(*alloc, this);
                         }
                     }
                 }
@@ -1211,8 +6153,8 @@ namespace algo {
             /** 
             * Returns true if data is stored in sub tree with root in this node
             */
-            bool Find(T target) {
-                ABTreeNode<T>* next_node = NULL;
+            bool Find(const T& target) {
+                ABTreeNode<T, Alloc>* next_node = NULL;
                 if(SearchList(target, &next_node) != NULL) return true;
                 else if(next_node == NULL) return false;
                 else return next_node->Find(target);
@@ -1221,15 +6163,15 @@ namespace algo {
             /*
             * Removes targeted node from sub tree with root in this node
             */
-            ABTreeNode<T>* Remove(T* target) {
+            ABTreeNode<T, Alloc>* Remove(T* target) {
                 // find way towards target
-                ABTreeNode<T>* next_node = NULL;
-                ABTreeKnot<T>* knot = SearchList(*target, &next_node);
+                ABTreeNode<T, Alloc>* next_node = NULL;
+                ABTreeKnot<T, Alloc>* knot = SearchList(*target, &next_node);
 
                 if(knot != NULL) {
                     // if this is the last layer, just delete right knot
                     if(last_layer) {
-                        ABTreeKnot<T>* del;
+                        ABTreeKnot<T, Alloc>* del;
                         // if its the first knot, just delete it
                         if(knot == list) {
                             del = list;
@@ -1237,17 +6179,17 @@ namespace algo {
                         }
                         // if its not, we first need to find previous knot to reconnect pointers
                         else {
-                            ABTreeKnot<T>* prev = FindPrev(knot);
+                            ABTreeKnot<T, Alloc>* prev = FindPrev(knot);
                             del = prev->next;
                             prev->next = knot->next;
                         }
                         --key_count; 
-                        delete del;
+                        Memory::Delete(*alloc, del);
                         return NULL; 
                     }
                     // else find knot in last layer to swap places with
                     else {
-                        ABTreeNode<T>* pt = knot->next->child;
+                        ABTreeNode<T, Alloc>* pt = knot->next->child;
                         while(!pt->IsLastLayer()) pt = pt->GetList()->child;
                         *target = pt->GetList()->key;
                         knot->key = *target;
@@ -1260,17 +6202,17 @@ namespace algo {
     
 
             // Setters and getters for some protected variables
-            void SetParentKnot(ABTreeKnot<T>* knot) { parent_knot = knot; }
+            void SetParentKnot(ABTreeKnot<T, Alloc>* knot) { parent_knot = knot; }
 
-            void SetParentNode(ABTreeNode<T>* node) { parent_node = node; }
+            void SetParentNode(ABTreeNode<T, Alloc>* node) { parent_node = node; }
 
-            ABTreeKnot<T>* GetParentKnot() { return parent_knot; }
+            ABTreeKnot<T, Alloc>* GetParentKnot() { return parent_knot; }
 
-            ABTreeNode<T>* GetParentNode() { return parent_node; }
+            ABTreeNode<T, Alloc>* GetParentNode() { return parent_node; }
             
-            void SetList(ABTreeKnot<T>* new_list) { list = new_list; }
+            void SetList(ABTreeKnot<T, Alloc>* new_list) { list = new_list; }
 
-            ABTreeKnot<T>* GetList() { return list; }
+            ABTreeKnot<T, Alloc>* GetList() { return list; }
 
             void SetKeyCount(int new_key_count) { key_count = new_key_count; }
 
@@ -1281,21 +6223,31 @@ namespace algo {
         protected:
             int key_count;
             bool last_layer;
-            ABTreeKnot<T>* parent_knot;
-            ABTreeNode<T>* parent_node;
-            ABTreeKnot<T>* list;
+            ABTreeKnot<T, Alloc>* parent_knot;
+            ABTreeNode<T, Alloc>* parent_node;
+            ABTreeKnot<T, Alloc>* list;
+            Alloc* alloc;
+
+            template <typename U>
+            ABTreeKnot<T, Alloc>* NewKnot(U&& key, ABTreeKnot<T, Alloc>* next, ABTreeNode<T, Alloc>* child) {
+                return new(alloc->Allocate(sizeof(ABTreeKnot<T, Alloc>))) ABTreeKnot<T, Alloc>(std::forward<U>(key), next, child);
+            }
+
+            ABTreeKnot<T, Alloc>* NewKnot(ABTreeNode<T, Alloc>* child) {
+                return new(alloc->Allocate(sizeof(ABTreeKnot<T, Alloc>))) ABTreeKnot<T, Alloc>(child);
+            }
                 
             
             /*
             * Handles changes in this node when some of child nodes splits
             */
-            void SplitChild(ABTreeKnot<T>* knot, ABTreeNode<T>* new_node, T new_key) {
+            void SplitChild(ABTreeKnot<T, Alloc>* knot, ABTreeNode<T, Alloc>* new_node, T new_key) {
                 // if this is the root node
                 if(parent_node == NULL) {
                     // making new root node
-                    ABTreeKnot<T>* second_knot = new ABTreeKnot<T>(new_node); 
-                    ABTreeKnot<T>* first_knot = new ABTreeKnot<T>(new_key, second_knot, list->child);
-                    list->child = new ABTreeNode<T>(1, false, this, first_knot);    
+                    ABTreeKnot<T, Alloc>* second_knot = NewKnot(new_node); 
+                    ABTreeKnot<T, Alloc>* first_knot = NewKnot(std::move(new_key), second_knot, list->child);
+                    list->child = new(alloc->Allocate(sizeof(ABTreeNode<T, Alloc>))) ABTreeNode<T, Alloc>(alloc, 1, false, this, first_knot);    
 
                     // setting right parent knots and nodes
                     new_node->SetParentNode(list->child);
@@ -1305,8 +6257,8 @@ namespace algo {
                 }
                 // if its not
                 else {
-                    knot->next = new ABTreeKnot<T>(knot->key, knot->next, new_node);
-                    knot->key = new_key;
+                    knot->next = NewKnot(std::move(knot->key), knot->next, new_node);
+                    knot->key = std::move(new_key);
                     new_node->SetParentKnot(knot->next);
                     ++key_count;
                 }
@@ -1318,8 +6270,8 @@ namespace algo {
             * On success returns pointer to right knot
             * Of fail returns NULL and stores pointer to right child in next_node
             */
-            ABTreeKnot<T>* SearchList(T target, ABTreeNode<T>** next_node) {
-                ABTreeKnot<T>* pt = list;
+            ABTreeKnot<T, Alloc>* SearchList(const T& target, ABTreeNode<T, Alloc>** next_node) {
+                ABTreeKnot<T, Alloc>* pt = list;
                 while(pt->next != NULL) {
                     if(pt->key == target) return pt;
                     else if(pt->key > target) {
@@ -1335,8 +6287,8 @@ namespace algo {
             /*
             * Returns pointer to node previous to knot in args.
             */ 
-            ABTreeKnot<T>* FindPrev(ABTreeKnot<T>* knot) {
-                ABTreeKnot<T>* pt = list;
+            ABTreeKnot<T, Alloc>* FindPrev(ABTreeKnot<T, Alloc>* knot) {
+                ABTreeKnot<T, Alloc>* pt = list;
                 while(pt->next != knot) {
                         pt = pt->next;
                 }
@@ -1349,19 +6301,25 @@ namespace algo {
     * AB Tree
     * 
     * @tparam T must be totally ordered and it must have defined >,<,= operators.
+    * @tparam Alloc allocator of the nodes, NewAllocator, PoolAllocator or ArenaAllocator.
     */
-    template <typename T>
+    template <typename T, typename Alloc = NewAllocator>
     class ABTree {
         public:
             /* 
             * a must be >=2 and b>=2*a-1
             */
-            ABTree(int _a, int _b): a(_a), b(_b), size(0) {
-                root = new ABTreeNode<T>();
-                root->GetList()->child = new ABTreeNode<T>(true);
+            ABTree(int _a, int _b, Alloc _alloc = Alloc()): a(_a), b(_b), size(0), alloc(_alloc) {
+                root = new(alloc.Allocate(sizeof(ABTreeNode<T, Alloc>))) ABTreeNode<T, Alloc>(&alloc);
+                root->GetList()->child = new(alloc.Allocate(sizeof(ABTreeNode<T, Alloc>))) ABTreeNode<T, Alloc>(&alloc, true);
                 root->GetList()->child->SetParentNode(root);
                 root->GetList()->child->SetParentKnot(NULL);
              }
+
+            ~ABTree() {
+                if(!Memory::ReleasesAll<T, Alloc>::value) Destroy(root);
+                alloc.Release();
+            }
             
             
             /**
@@ -1370,10 +6328,21 @@ namespace algo {
             *
             * @param data Item that will be inserted.
             */
-            void Insert(T data) { 
+            void Insert(const T& data) { 
                 Insert(data, root->GetList()->child); 
                 ++size;
             }
+
+            /**
+            * Moves new item into structure.
+            * T(n) = O(log(n)), where n is number of items stored in structure.
+            *
+            * @param data Item that will be inserted, it is left in moved-from state.
+            */
+            void Insert(T&& data) { 
+                Insert(std::move(data), root->GetList()->child); 
+                ++size;
+            }
             
             /**
             * Removes item into structure.
@@ -1381,8 +6350,10 @@ namespace algo {
             *
             * @param data Item that will be removed.
             */
-            void Remove(T data) { 
-                Remove(data, root->GetList()->child); 
+            void Remove(const T& data) { 
+                // the key is replaced by its successor on the way down, so it is copied once
+                T target = data;
+                Remove(&target, root->GetList()->child); 
                 --size;
             }
             
@@ -1392,24 +6363,68 @@ namespace algo {
             *
             * @param data Item that will be searched for.
             */
-            bool Find(T data) { return root->GetList()->child->Find(data); }
+            bool Find(const T& data) { return root->GetList()->child->Find(data); }
+
+            /**
+            * Returns height of the tree and its split and join stats, which stay zero unless ALGO_STATS is defined.
+            * T(n) = O(log(n)), where n is number of items stored in structure.
+            */
+            TreeStats GetStats() {
+#ifdef ALGO_STATS
+                TreeStats result = stats;
+#else
+                TreeStats result = TreeStats();
+#endif
+                result.height = 1;
+                for(ABTreeNode<T, Alloc>* node = root->GetList()->child; !node->IsLastLayer(); node = node->GetList()->child) ++result.height;
+                return result;
+            }
 
         protected:
             int a;
             int b;
             int size;
-            ABTreeNode<T>* root;
+            ABTreeNode<T, Alloc>* root;
+#ifdef ALGO_STATS
+            TreeStats stats = TreeStats();
+#endif
+            Alloc alloc;
+
+        private:
+            ABTree(const ABTree&);
+            ABTree& operator=(const ABTree&);
+
+            // frees node with its knots and subtrees
+            void Destroy(ABTreeNode<T, Alloc>* node) {
+                ABTreeKnot<T, Alloc>* knot = node->GetList();
+                while(knot != NULL) {
+                    ABTreeKnot<T, Alloc>* next = knot->next;
+                    if(!node->IsLastLayer()) Destroy(knot->child);
+                    Memory::Delete(alloc, knot);
+                    knot = next;
+                }
+                Memory::Delete(alloc, node);
+            }
 
-            void Insert(T data, ABTreeNode<T>* node) {
-                ABTreeNode<T>* next_node = node->Insert(data);
-                if(next_node != NULL) Insert(data, next_node);
-                if(node->GetKeyCount() > b) node->Split();
+            // data is moved from only by the node it is inserted into, the other nodes just pass it down
+            template <typename U>
+            void Insert(U&& data, ABTreeNode<T, Alloc>* node) {
+                ABTreeNode<T, Alloc>* next_node = node->Insert(std::forward<U>(data));
+                if(next_node != NULL) Insert(std::forward<U>(data), next_node);
+                if(node->GetKeyCount() > b) {
+                    ALGO_TREE_STAT(splits, 1);
+                    node->Split();
+                }
             }
 
-            void Remove(T data, ABTreeNode<T>* node) {
-                ABTreeNode<T>* next_node = node->Remove(&data);
-                if(next_node != NULL) Remove(data, next_node);
-                if(node->GetKeyCount() < a) node->Join(a);
+            void Remove(T* target, ABTreeNode<T, Alloc>* node) {
+                ABTreeNode<T, Alloc>* next_node = node->Remove(target);
+                if(next_node != NULL) Remove(target, next_node);
+                if(node->GetKeyCount() < a) {
+                    // the root has no brother, it only shrinks when it has no keys left
+                    if(node->GetParentKnot() != NULL) ALGO_TREE_STAT(joins, 1);
+                    node->Join(a);
+                }
             }
             
     };
@@ -0,0 +1,429 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "algo.h"
+
+using namespace algo;
+
+// Benchmarks of algorithms and data structures of algo.h.
+//
+// Usage: bench [max_len [filter]]
+//   max_len  largest input length, inputs are 1K, 10K, ... up to max_len (default 100M).
+//   filter   runs only benchmarks whose name contains filter.
+//
+// Prints one CSV line per benchmark, operation, distribution and length:
+//   benchmark,operation,distribution,n,reps,ns_per_elem,melem_per_s,p50_ns,p99_ns
+// ns_per_elem and melem_per_s are averages over all repetitions. p50_ns and p99_ns are percentiles of
+// ns per element of single samples, a sample is one repetition of a sort or a batch of BATCH operations.
+
+typedef std::chrono::steady_clock Clock;
+
+const ptrdiff_t MIN_LEN = 1000;
+const ptrdiff_t MAX_LEN = 100000000;
+// Containers allocate a node per element, 100M of them would not fit into memory of common machines.
+const ptrdiff_t CONTAINER_MAX_LEN = 10000000;
+// Short inputs are repeated until at least TARGET_ELEMS elements are processed, long ones MIN_REPS times.
+const ptrdiff_t TARGET_ELEMS = 2000000;
+const int MIN_REPS = 3;
+// Single operations are too short for the clock, they are timed in batches of this size.
+const int BATCH = 16;
+// Percentiles are computed from a uniform random sample of at most this many samples.
+const ptrdiff_t MAX_SAMPLES = 1 << 20;
+
+enum Distribution { RANDOM, SORTED, REVERSED, ORGAN_PIPE, FEW_UNIQUE, DISTRIBUTIONS };
+const char* DISTRIBUTION_NAMES[DISTRIBUTIONS] = {"random", "sorted", "reversed", "organ-pipe", "few-unique"};
+// Number of distinct values of FEW_UNIQUE.
+const int FEW = 16;
+
+/**
+* Deterministic pseudo-random generator, splitmix64.
+*/
+inline uint64_t NextRandom(uint64_t* state) {
+    uint64_t z = (*state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+/**
+* Fills arr with n values of distribution. All distributions except FEW_UNIQUE are permutations of [0, n).
+*/
+void Generate(int* arr, ptrdiff_t n, Distribution distribution) {
+    uint64_t state = 42;
+    for(ptrdiff_t i=0; i<n; ++i) {
+        switch(distribution) {
+            case RANDOM: case SORTED: arr[i] = (int)i; break;
+            case REVERSED: arr[i] = (int)(n - 1 - i); break;
+            case ORGAN_PIPE: arr[i] = (int)(2*i < n? 2*i: 2*(n-1-i) + 1); break;
+            default: arr[i] = (int)(NextRandom(&state) % FEW);
+        }
+    }
+    if(distribution == RANDOM) {
+        for(ptrdiff_t i=n-1; i>0; --i) ArrSwap<int>(arr, i, (ptrdiff_t)(NextRandom(&state) % (uint64_t)(i + 1)));
+    }
+}
+
+/**
+* Times of one benchmark operation.
+*/
+struct Stats {
+    double total_ns;
+    ptrdiff_t elems;
+    ptrdiff_t seen;
+    ptrdiff_t count;
+    double* samples;
+    uint64_t state;
+
+    Stats(): total_ns(0), elems(0), seen(0), count(0), samples(new double[MAX_SAMPLES]), state(7) {}
+    ~Stats() { delete[] samples; }
+
+    void Clear() { total_ns = 0; elems = 0; seen = 0; count = 0; }
+
+    /**
+    * Adds sample of elems elements processed in ns nanoseconds, keeps a uniform random subset (reservoir).
+    */
+    void Add(double ns, ptrdiff_t e) {
+        total_ns += ns;
+        elems += e;
+        ++seen;
+        if(count < MAX_SAMPLES) samples[count++] = ns / e;
+        else {
+            ptrdiff_t idx = (ptrdiff_t)(NextRandom(&state) % (uint64_t)seen);
+            if(idx < MAX_SAMPLES) samples[idx] = ns / e;
+        }
+    }
+
+    double Percentile(double p) {
+        ptrdiff_t idx = Min<ptrdiff_t>(count - 1, (ptrdiff_t)(p * count));
+        ArrNthElement<double>(samples, count, idx);
+        return samples[idx];
+    }
+};
+
+inline double Elapsed(Clock::time_point beg) {
+    return (double)std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - beg).count();
+}
+
+void Fail(const char* name) {
+    fprintf(stderr, "Error %s\n", name);
+    exit(1);
+}
+
+
+///////////////////////
+//// BENCHMARKS
+///////////////////////
+
+// One repetition of a benchmark on data of length n, stats[i] collects times of operation i.
+
+template <void (*SortFn)(int*, ptrdiff_t)>
+void BenchSort(const int* data, ptrdiff_t n, int* work, Stats* stats) {
+    memcpy(work, data, n * sizeof(int));
+    Clock::time_point beg = Clock::now();
+    SortFn(work, n);
+    stats[0].Add(Elapsed(beg), n);
+    for(ptrdiff_t i=1; i<n; ++i) if(work[i-1] > work[i]) Fail("sort");
+}
+
+void RunHeapSort(int* arr, ptrdiff_t n) { ArrHeapSort<int>(arr, n); }
+void RunMergeSort(int* arr, ptrdiff_t n) { ArrMergeSort<int>(arr, n); }
+void RunParallelMergeSort(int* arr, ptrdiff_t n) { ArrParallelMergeSort<int>(arr, n); }
+void RunQuickSort(int* arr, ptrdiff_t n) { ArrQuickSort<int>(arr, n); }
+void RunSort(int* arr, ptrdiff_t n) { ArrSort<int>(arr, n); }
+void RunCountSort(int* arr, ptrdiff_t n) { CountSort(arr, n); }
+void RunParallelCountSort(int* arr, ptrdiff_t n) { ArrParallelCountSort(arr, n); }
+void RunRadixSort(int* arr, ptrdiff_t n) { ArrRadixSort(arr, n); }
+
+// Element owning a heap buffer, copying allocates and fills a new one, moving takes the buffer over.
+struct Heavy {
+    static const int PAYLOAD = 16;
+    int key;
+    int* payload;
+
+    Heavy(): key(0), payload(NULL) {}
+    Heavy(int k): key(k), payload(new int[PAYLOAD]()) {}
+    Heavy(const Heavy& other): key(other.key), payload(NULL) { CopyPayload(other); }
+    Heavy(Heavy&& other): key(other.key), payload(other.payload) { other.payload = NULL; }
+    ~Heavy() { delete[] payload; }
+
+    Heavy& operator=(const Heavy& other) {
+        if(this != &other) {
+            key = other.key;
+            CopyPayload(other);
+        }
+        return *this;
+    }
+
+    Heavy& operator=(Heavy&& other) {
+        if(this != &other) {
+            key = other.key;
+            delete[] payload;
+            payload = other.payload;
+            other.payload = NULL;
+        }
+        return *this;
+    }
+
+    bool operator<(const Heavy& other) const { return key < other.key; }
+    bool operator>(const Heavy& other) const { return key > other.key; }
+
+    void CopyPayload(const Heavy& other) {
+        delete[] payload;
+        payload = NULL;
+        if(other.payload) {
+            payload = new int[PAYLOAD];
+            memcpy(payload, other.payload, PAYLOAD * sizeof(int));
+        }
+    }
+};
+
+// Sorts elements that are expensive to copy, only moving them is cheap.
+template <void (*SortFn)(Heavy*, ptrdiff_t)>
+void BenchHeavySort(const int* data, ptrdiff_t n, int*, Stats* stats) {
+    Heavy* work = new Heavy[n];
+    for(ptrdiff_t i=0; i<n; ++i) work[i] = Heavy(data[i]);
+    Clock::time_point beg = Clock::now();
+    SortFn(work, n);
+    stats[0].Add(Elapsed(beg), n);
+    for(ptrdiff_t i=1; i<n; ++i) if(work[i-1].key > work[i].key || work[i].payload == NULL) Fail("heavy sort");
+    delete[] work;
+}
+
+void RunHeavyMergeSort(Heavy* arr, ptrdiff_t n) { ArrMergeSort<Heavy>(arr, n); }
+void RunHeavyQuickSort(Heavy* arr, ptrdiff_t n) { ArrQuickSort<Heavy>(arr, n); }
+
+// Searches the sorted data for all its elements in the order of the distribution.
+void BenchBinarySearch(const int* data, ptrdiff_t n, int* work, Stats* stats) {
+    memcpy(work, data, n * sizeof(int));
+    ArrRadixSort(work, n);
+    ptrdiff_t found = 0;
+    for(ptrdiff_t i=0; i+BATCH<=n; i+=BATCH) {
+        Clock::time_point beg = Clock::now();
+        for(int j=0; j<BATCH; ++j) found += BinarySearch<int>(work, data[i+j], 0, n-1);
+        stats[0].Add(Elapsed(beg), BATCH);
+    }
+    if(found != n / BATCH * BATCH) Fail("BinarySearch");
+}
+
+template <typename List>
+void BenchQueue(const int* data, ptrdiff_t n, int*, Stats* stats) {
+    List list;
+    for(ptrdiff_t i=0; i+BATCH<=n; i+=BATCH) {
+        Clock::time_point beg = Clock::now();
+        for(int j=0; j<BATCH; ++j) list.Insert(data[i+j]);
+        stats[0].Add(Elapsed(beg), BATCH);
+    }
+    long long sum = 0;
+    for(ptrdiff_t i=0; i+BATCH<=n; i+=BATCH) {
+        Clock::time_point beg = Clock::now();
+        for(int j=0; j<BATCH; ++j) sum += list.Remove();
+        stats[1].Add(Elapsed(beg), BATCH);
+    }
+    if(sum < 0) Fail("queue");
+}
+
+// Capacity of the concurrent queues.
+const ptrdiff_t QUEUE_CAPACITY = 1 << 12;
+
+template <typename Queue>
+void QueueProducer(Queue* queue, const int* data, ptrdiff_t n) {
+    for(ptrdiff_t i=0; i+BATCH<=n; i+=BATCH) queue->InsertBatch(data + i, BATCH);
+}
+
+// Elements go from a producer thread to the measuring consumer thread in batches.
+void BenchSPSCQueue(const int* data, ptrdiff_t n, int* work, Stats* stats) {
+    SPSCQueue<int> queue(QUEUE_CAPACITY);
+    std::thread producer(QueueProducer<SPSCQueue<int> >, &queue, data, n);
+    for(ptrdiff_t i=0; i+BATCH<=n; i+=BATCH) {
+        Clock::time_point beg = Clock::now();
+        queue.RemoveBatch(work + i, BATCH);
+        stats[0].Add(Elapsed(beg), BATCH);
+    }
+    producer.join();
+    if(memcmp(data, work, n / BATCH * BATCH * sizeof(int)) != 0) Fail("SPSCQueue");
+}
+
+template <typename Queue>
+void ConcurrentProducer(Queue* queue, const int* data, ptrdiff_t len) {
+    for(ptrdiff_t i=0; i<len; ++i) queue->Insert(data[i]);
+}
+
+template <typename Queue>
+void ConcurrentConsumer(Queue* queue, int* out, ptrdiff_t len) {
+    for(ptrdiff_t i=0; i<len; ++i) out[i] = queue->Remove();
+}
+
+// THREADS/2 producers pass all elements to THREADS/2 consumers, one thread inserts and removes batches.
+// A sample is the whole transfer, with thread creation.
+template <int THREADS, typename Queue>
+void BenchConcurrent(Queue* queue, const int* data, ptrdiff_t n, int* work, Stats* stats) {
+    Clock::time_point beg = Clock::now();
+    if(THREADS == 1) {
+        for(ptrdiff_t i=0; i<n; i+=BATCH) {
+            ptrdiff_t len = Min<ptrdiff_t>(BATCH, n - i);
+            ConcurrentProducer(queue, data + i, len);
+            ConcurrentConsumer(queue, work + i, len);
+        }
+    }
+    else {
+        const int pairs = THREADS / 2;
+        std::thread threads[THREADS];
+        for(int p=0; p<pairs; ++p) {
+            ptrdiff_t part_beg = n * p / pairs;
+            ptrdiff_t part_len = n * (p+1) / pairs - part_beg;
+            threads[2*p] = std::thread(ConcurrentProducer<Queue>, queue, data + part_beg, part_len);
+            threads[2*p+1] = std::thread(ConcurrentConsumer<Queue>, queue, work + part_beg, part_len);
+        }
+        for(int t=0; t<2*pairs; ++t) threads[t].join();
+    }
+    stats[0].Add(Elapsed(beg), n);
+    long long data_sum = 0, work_sum = 0;
+    for(ptrdiff_t i=0; i<n; ++i) {
+        data_sum += data[i];
+        work_sum += work[i];
+    }
+    if(data_sum != work_sum) Fail("concurrent");
+}
+
+template <int THREADS>
+void BenchMPMCQueue(const int* data, ptrdiff_t n, int* work, Stats* stats) {
+    MPMCQueue<int> queue(QUEUE_CAPACITY);
+    BenchConcurrent<THREADS>(&queue, data, n, work, stats);
+}
+
+template <int THREADS>
+void BenchConcurrentLIFO(const int* data, ptrdiff_t n, int* work, Stats* stats) {
+    ConcurrentLIFO<int> stack;
+    BenchConcurrent<THREADS>(&stack, data, n, work, stats);
+}
+
+void BenchSinglyLL(const int* data, ptrdiff_t n, int*, Stats* stats) {
+    SinglyLL<int> list;
+    for(ptrdiff_t i=0; i+BATCH<=n; i+=BATCH) {
+        Clock::time_point beg = Clock::now();
+        for(int j=0; j<BATCH; ++j) list.Append(data[i+j]);
+        stats[0].Add(Elapsed(beg), BATCH);
+    }
+    long long sum = 0;
+    for(ptrdiff_t i=0; i+BATCH<=n; i+=BATCH) {
+        Clock::time_point beg = Clock::now();
+        for(int j=0; j<BATCH; ++j) sum += list.RemoveFirst();
+        stats[1].Add(Elapsed(beg), BATCH);
+    }
+    if(sum < 0) Fail("SinglyLL");
+}
+
+// Inserts, finds and removes the elements in the order of the distribution.
+template <typename Tree>
+void BenchTree(Tree* tree, const int* data, ptrdiff_t n, Stats* stats) {
+    for(ptrdiff_t i=0; i+BATCH<=n; i+=BATCH) {
+        Clock::time_point beg = Clock::now();
+        for(int j=0; j<BATCH; ++j) tree->Insert(data[i+j]);
+        stats[0].Add(Elapsed(beg), BATCH);
+    }
+    ptrdiff_t found = 0;
+    for(ptrdiff_t i=0; i+BATCH<=n; i+=BATCH) {
+        Clock::time_point beg = Clock::now();
+        for(int j=0; j<BATCH; ++j) found += tree->Find(data[i+j]);
+        stats[1].Add(Elapsed(beg), BATCH);
+    }
+    if(found != n / BATCH * BATCH) Fail("tree");
+    for(ptrdiff_t i=0; i+BATCH<=n; i+=BATCH) {
+        Clock::time_point beg = Clock::now();
+        for(int j=0; j<BATCH; ++j) tree->Remove(data[i+j]);
+        stats[2].Add(Elapsed(beg), BATCH);
+    }
+}
+
+template <typename Alloc>
+void BenchAVLTree(const int* data, ptrdiff_t n, int*, Stats* stats) {
+    AVLTree<int, Alloc> tree;
+    BenchTree(&tree, data, n, stats);
+}
+
+template <int A, int B, typename Alloc>
+void BenchABTree(const int* data, ptrdiff_t n, int*, Stats* stats) {
+    ABTree<int, Alloc> tree(A, B);
+    BenchTree(&tree, data, n, stats);
+}
+
+struct Benchmark {
+    const char* name;
+    const char* operations[3];
+    // Longest input, trees also need distinct keys.
+    ptrdiff_t max_len;
+    bool distinct;
+    void (*run)(const int* data, ptrdiff_t n, int* work, Stats* stats);
+};
+
+const Benchmark BENCHMARKS[] = {
+    {"ArrHeapSort", {"sort"}, MAX_LEN, false, BenchSort<RunHeapSort>},
+    {"ArrMergeSort", {"sort"}, MAX_LEN, false, BenchSort<RunMergeSort>},
+    {"ArrParallelMergeSort", {"sort"}, MAX_LEN, false, BenchSort<RunParallelMergeSort>},
+    {"ArrQuickSort", {"sort"}, MAX_LEN, false, BenchSort<RunQuickSort>},
+    {"ArrSort", {"sort"}, MAX_LEN, false, BenchSort<RunSort>},
+    {"CountSort", {"sort"}, MAX_LEN, false, BenchSort<RunCountSort>},
+    {"ArrParallelCountSort", {"sort"}, MAX_LEN, false, BenchSort<RunParallelCountSort>},
+    {"ArrRadixSort", {"sort"}, MAX_LEN, false, BenchSort<RunRadixSort>},
+    {"ArrMergeSort/Heavy", {"sort"}, CONTAINER_MAX_LEN, false, BenchHeavySort<RunHeavyMergeSort>},
+    {"ArrQuickSort/Heavy", {"sort"}, CONTAINER_MAX_LEN, false, BenchHeavySort<RunHeavyQuickSort>},
+    {"BinarySearch", {"find"}, MAX_LEN, false, BenchBinarySearch},
+    {"SinglyLL", {"append", "remove_first"}, CONTAINER_MAX_LEN, false, BenchSinglyLL},
+    {"FIFO", {"insert", "remove"}, CONTAINER_MAX_LEN, false, BenchQueue<FIFO<int> >},
+    {"LIFO", {"insert", "remove"}, CONTAINER_MAX_LEN, false, BenchQueue<LIFO<int> >},
+    {"SPSCQueue", {"transfer"}, MAX_LEN, false, BenchSPSCQueue},
+    {"MPMCQueue/1", {"transfer"}, CONTAINER_MAX_LEN, false, BenchMPMCQueue<1>},
+    {"MPMCQueue/2", {"transfer"}, CONTAINER_MAX_LEN, false, BenchMPMCQueue<2>},
+    {"MPMCQueue/4", {"transfer"}, CONTAINER_MAX_LEN, false, BenchMPMCQueue<4>},
+    {"MPMCQueue/8", {"transfer"}, CONTAINER_MAX_LEN, false, BenchMPMCQueue<8>},
+    {"MPMCQueue/16", {"transfer"}, CONTAINER_MAX_LEN, false, BenchMPMCQueue<16>},
+    {"MPMCQueue/32", {"transfer"}, CONTAINER_MAX_LEN, false, BenchMPMCQueue<32>},
+    {"MPMCQueue/64", {"transfer"}, CONTAINER_MAX_LEN, false, BenchMPMCQueue<64>},
+    {"ConcurrentLIFO/1", {"transfer"}, CONTAINER_MAX_LEN, false, BenchConcurrentLIFO<1>},
+    {"ConcurrentLIFO/2", {"transfer"}, CONTAINER_MAX_LEN, false, BenchConcurrentLIFO<2>},
+    {"ConcurrentLIFO/4", {"transfer"}, CONTAINER_MAX_LEN, false, BenchConcurrentLIFO<4>},
+    {"ConcurrentLIFO/8", {"transfer"}, CONTAINER_MAX_LEN, false, BenchConcurrentLIFO<8>},
+    {"ConcurrentLIFO/16", {"transfer"}, CONTAINER_MAX_LEN, false, BenchConcurrentLIFO<16>},
+    {"ConcurrentLIFO/32", {"transfer"}, CONTAINER_MAX_LEN, false, BenchConcurrentLIFO<32>},
+    {"ConcurrentLIFO/64", {"transfer"}, CONTAINER_MAX_LEN, false, BenchConcurrentLIFO<64>},
+    {"AVLTree", {"insert", "find", "remove"}, CONTAINER_MAX_LEN, true, BenchAVLTree<NewAllocator>},
+    {"AVLTree/PoolAllocator", {"insert", "find", "remove"}, CONTAINER_MAX_LEN, true, BenchAVLTree<PoolAllocator>},
+    {"AVLTree/ArenaAllocator", {"insert", "find", "remove"}, CONTAINER_MAX_LEN, true, BenchAVLTree<ArenaAllocator>},
+    {"ABTree(2,4)", {"insert", "find", "remove"}, CONTAINER_MAX_LEN, true, BenchABTree<2, 4, NewAllocator>},
+    {"ABTree(2,4)/PoolAllocator", {"insert", "find", "remove"}, CONTAINER_MAX_LEN, true, BenchABTree<2, 4, PoolAllocator>},
+    {"ABTree(4,100)", {"insert", "find", "remove"}, CONTAINER_MAX_LEN, true, BenchABTree<4, 100, NewAllocator>},
+};
+
+int main(int argc, char** argv) {
+    ptrdiff_t max_len = argc > 1? (ptrdiff_t)atoll(argv[1]): MAX_LEN;
+    const char* filter = argc > 2? argv[2]: "";
+    int benchmarks = (int)(sizeof(BENCHMARKS) / sizeof(BENCHMARKS[0]));
+
+    int* data = new int[max_len];
+    int* work = new int[max_len];
+    Stats stats[3];
+
+    printf("benchmark,operation,distribution,n,reps,ns_per_elem,melem_per_s,p50_ns,p99_ns\n");
+    for(ptrdiff_t n=MIN_LEN; n<=max_len; n*=10) {
+        for(int d=0; d<DISTRIBUTIONS; ++d) {
+            Generate(data, n, (Distribution)d);
+            for(int b=0; b<benchmarks; ++b) {
+                const Benchmark& bench = BENCHMARKS[b];
+                if(n > bench.max_len || (bench.distinct && d == FEW_UNIQUE) || !strstr(bench.name, filter)) continue;
+                for(int op=0; op<3; ++op) stats[op].Clear();
+                int reps = (int)Max<ptrdiff_t>(MIN_REPS, TARGET_ELEMS / n);
+                for(int r=0; r<reps; ++r) bench.run(data, n, work, stats);
+                for(int op=0; op<3 && bench.operations[op]; ++op) {
+                    double ns = stats[op].total_ns / stats[op].elems;
+                    printf("%s,%s,%s,%td,%d,%.3f,%.3f,%.3f,%.3f\n", bench.name, bench.operations[op], DISTRIBUTION_NAMES[d],
+                           n, reps, ns, 1e3 / ns, stats[op].Percentile(0.5), stats[op].Percentile(0.99));
+                }
+                fflush(stdout);
+            }
+        }
+    }
+
+    delete[] data;
+    delete[] work;
+}
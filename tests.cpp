@@ -1,9 +1,84 @@
 #include <stdio.h>
+#include <string>
 
+// count comparisons, swaps and tree rebalancing
+#define ALGO_STATS
 #include "algo.h"
 
 using namespace algo;
 
+// record sorted by key, id keeps the original position
+struct Record {
+    int key;
+    int id;
+};
+
+// record of 32 bytes, sorted by key
+struct WideRecord {
+    int64_t key;
+    int64_t a, b, c;
+};
+
+// element that counts its copies and moves, moving leaves a key larger than all others
+struct Counted {
+    static int copies;
+    static int moves;
+    int key;
+    Counted(int k = 0): key(k) {}
+    Counted(const Counted& other): key(other.key) { ++copies; }
+    Counted(Counted&& other): key(other.key) { other.key = 1 << 30; ++moves; }
+    Counted& operator=(const Counted& other) { key = other.key; ++copies; return *this; }
+    Counted& operator=(Counted&& other) { key = other.key; other.key = 1 << 30; ++moves; return *this; }
+    bool operator<(const Counted& other) const { return key < other.key; }
+    bool operator>(const Counted& other) const { return key > other.key; }
+    bool operator==(const Counted& other) const { return key == other.key; }
+};
+int Counted::copies = 0;
+int Counted::moves = 0;
+
+// element without a default constructor that counts its live objects
+struct Alive {
+    static int count;
+    int key;
+    explicit Alive(int k): key(k) { ++count; }
+    Alive(const Alive& other): key(other.key) { ++count; }
+    ~Alive() { --count; }
+};
+int Alive::count = 0;
+
+// producer of the concurrent queue tests, inserts first, ..., first+count-1, the second half in batches
+template <typename Queue>
+void QueueProducer(Queue* queue, int first, int count) {
+    for(int i=0; i<count/2; ++i) queue->Insert(first + i);
+    int batch[7];
+    for(int i=count/2; i<count; i+=7) {
+        int len = Min(7, count - i);
+        for(int j=0; j<len; ++j) batch[j] = first + i + j;
+        queue->InsertBatch(batch, len);
+    }
+}
+
+// producer of the multi-threaded tests, inserts first, ..., first+count-1
+template <typename Queue>
+void ConcurrentProducer(Queue* queue, int first, int count) {
+    for(int i=0; i<count; ++i) queue->Insert(first + i);
+}
+
+// consumer of the multi-threaded tests, stores count removed elements to out
+template <typename Queue>
+void ConcurrentConsumer(Queue* queue, int count, int* out) {
+    for(int i=0; i<count; ++i) out[i] = queue->Remove();
+}
+
+// worker of the multi-threaded tests, inserts first, ..., first+count-1 and after each insertion removes one element to out
+template <typename Queue>
+void ConcurrentInsertRemove(Queue* queue, int first, int count, int* out) {
+    for(int i=0; i<count; ++i) {
+        queue->Insert(first + i);
+        out[i] = queue->Remove();
+    }
+}
+
 int main() {
     
 
@@ -30,6 +105,69 @@ int main() {
     }
     
 
+    // min and max
+    /////////////////
+
+    // values repeat, the first index of min and max is expected
+    double* arr_d = new double[n];
+    float* arr_mf = new float[n];
+    for(int i=0; i<n; ++i) {
+        arr_d[i] = arr1[i] % 1000 * 0.5;
+        arr_mf[i] = (float)(arr1[i] % 1000);
+    }
+    int min_i, max_i;
+    ptrdiff_t min_idx, max_idx;
+    ArrMinMax<int>(arr1, n, &min_i, &max_i, &min_idx, &max_idx);
+    if(min_i != ArrMin<int>(arr1, n) || max_i != ArrMax<int>(arr1, n) || arr1[min_idx] != min_i || arr1[max_idx] != max_i) printf("Error min max\n");
+    for(int i=0; i<n; ++i) if(arr1[i] < min_i || arr1[i] > max_i) printf("Error min max\n");
+    double min_d, max_d;
+    float min_f, max_f;
+    int ref_min = 0, ref_max = 0;
+    for(int i=1; i<n; ++i) {
+        if(arr_d[i] < arr_d[ref_min]) ref_min = i;
+        if(arr_d[ref_max] < arr_d[i]) ref_max = i;
+    }
+    ArrMinMax<double>(arr_d, n, &min_d, &max_d, &min_idx, &max_idx);
+    if(min_idx != ref_min || max_idx != ref_max || min_d != arr_d[ref_min] || max_d != arr_d[ref_max]) printf("Error min max\n");
+    ArrMinMax<float>(arr_mf, n, &min_f, &max_f, &min_idx, &max_idx);
+    if(min_idx != ref_min || max_idx != ref_max || min_f != arr_mf[ref_min] || max_f != arr_mf[ref_max]) printf("Error min max\n");
+    ArrMax<double>(arr_d, n, &max_idx);
+    ArrMin<float>(arr_mf, n, &min_idx);
+    if(min_idx != ref_min || max_idx != ref_max) printf("Error min max\n");
+    ArrMinMax<double>(arr_d, n, &min_d, &max_d, &min_idx, &max_idx, Greater());
+    if(min_idx != ref_max || max_idx != ref_min) printf("Error min max\n");
+    delete[] arr_d;
+    delete[] arr_mf;
+
+    printf("End of min max\n");
+
+
+    // parallel reductions
+    ///////////////////////
+
+    // long array, so it is split into chunks for several threads
+    int big_n = 300000;
+    int* big = new int[big_n];
+    long long big_sum = 0;
+    int big_count = 0;
+    for(int i=0; i<big_n; ++i) {
+        big[i] = (int)((long long)i*koef1 % koef2) - koef2/2;
+        big_sum += big[i];
+        if(big[i] == 7) ++big_count;
+    }
+    ptrdiff_t big_max_idx, big_min_idx;
+    int big_max = ArrParallelMax<int>(big, big_n, &big_max_idx, 4);
+    int big_min = ArrParallelMin<int>(big, big_n, &big_min_idx, 4);
+    if(big_max != ArrMax<int>(big, big_n, &max_idx) || big_max_idx != max_idx) printf("Error parallel reduction\n");
+    if(big_min != ArrMin<int>(big, big_n, &min_idx) || big_min_idx != min_idx) printf("Error parallel reduction\n");
+    if(ArrSum<int, long long>(big, big_n, 4) != big_sum || ArrSum<int, long long>(big, 100, 4) != ArrSum<int, long long>(big, 100, 1)) printf("Error parallel reduction\n");
+    if(ArrCount<int>(big, big_n, 7, 3) != big_count) printf("Error parallel reduction\n");
+    if(ArrReduce<int>(big, big_n, -koef2, Max<int>, 4) != big_max) printf("Error parallel reduction\n");
+    delete[] big;
+
+    printf("End of parallel reduction\n");
+
+
     // heap sort
     /////////////
 
@@ -39,6 +177,13 @@ int main() {
     // check if sorted arrays are ascending/descending
     for(int i=0; i<n-1; ++i) if(arr1[i] > arr1[i+1]) printf("Error heap sort\n");
     for(int i=0; i<n-1; ++i) if(arr2[i] < arr2[i+1]) printf("Error heap sort\n");
+
+    // binary and 8-ary heap
+    for(int i=0; i<n; ++i) arr3[i] = (i*koef1) % koef2;
+    ArrHeapSort<int, 2>(arr3, n);
+    for(int i=0; i<n; ++i) if(arr1[i] != arr3[i]) printf("Error heap sort\n");
+    ArrHeapSort<int, 8>(arr3, n, false);
+    for(int i=0; i<n; ++i) if(arr2[i] != arr3[i]) printf("Error heap sort\n");
     
     printf("End of heap sort\n");
    
@@ -50,8 +195,71 @@ int main() {
     
     // compare to sorted array
     for(int i=0; i<n; ++i) if(arr1[i] != arr3[i]) printf("Error merge sort\n");
+
+    // bottom-up merge sort with reused buffer
+    int* buf = new int[n];
+    for(int i=0; i<n; ++i) arr3[i] = (i*koef1) % koef2;
+    ArrMergeSortBottomUp<int>(arr3, n, buf);
+    for(int i=0; i<n; ++i) if(arr1[i] != arr3[i]) printf("Error merge sort\n");
+    for(int i=0; i<n; ++i) arr3[i] = (i*koef1) % koef2;
+    ArrMergeSort<int>(arr3, n, buf);
+    for(int i=0; i<n; ++i) if(arr1[i] != arr3[i]) printf("Error merge sort\n");
+    delete[] buf;
+
+    // vectorized merge sort of floats and 64-bit integers
+    float* arr_f = new float[n];
+    uint64_t* arr_u = new uint64_t[n];
+    for(int i=0; i<n; ++i) {
+        arr_f[i] = ((i*koef1) % koef2) * 0.5f;
+        arr_u[i] = (uint64_t)((i*koef1) % koef2) << 33;
+    }
+    ArrMergeSort<float>(arr_f, n);
+    ArrMergeSort<uint64_t>(arr_u, n);
+    for(int i=0; i<n; ++i) if(arr_f[i] != arr1[i] * 0.5f || arr_u[i] != (uint64_t)arr1[i] << 33) printf("Error merge sort\n");
+    delete[] arr_f;
+    delete[] arr_u;
     
     printf("End of merge sort\n");
+
+    // quick sort
+    /////////////
+
+    for(int i=0; i<n; ++i) arr3[i] = (i*koef1) % koef2;
+    ResetThreadStats();
+    ArrQuickSort<int>(arr3, n);
+    for(int i=0; i<n; ++i) if(arr1[i] != arr3[i]) printf("Error quick sort\n");
+    ThreadStats quick_stats = GetThreadStats();
+    if(quick_stats.comparisons < (uint64_t)n || quick_stats.swaps == 0 || quick_stats.max_depth < 2 || quick_stats.depth != 0) printf("Error sort stats\n");
+
+    // sorted, reversed and many duplicates
+    ArrQuickSort<int>(arr3, n);
+    for(int i=0; i<n; ++i) if(arr1[i] != arr3[i]) printf("Error quick sort\n");
+    for(int i=0; i<n; ++i) arr3[i] = arr2[i];
+    ArrQuickSort<int>(arr3, n);
+    for(int i=0; i<n; ++i) if(arr1[i] != arr3[i]) printf("Error quick sort\n");
+    for(int i=0; i<n; ++i) arr3[i] = (i*koef1) % 7;
+    ArrQuickSort<int>(arr3, n);
+    for(int i=0; i<n-1; ++i) if(arr3[i] > arr3[i+1]) printf("Error quick sort\n");
+
+    printf("End of quick sort\n");
+
+    // parallel merge sort
+    ///////////////////////
+
+    int* arr5 = new int[n];
+    double* arr6 = new double[n];
+    for(int i=0; i<n; ++i) {
+        arr5[i] = (i*koef1) % koef2;
+        arr6[i] = (i*koef1) % koef2;
+    }
+
+    ArrParallelMergeSort<int>(arr5, n, 4, 16);
+    ArrParallelMergeSort<double>(arr6, n, 3, 1);
+
+    // compare to sorted array
+    for(int i=0; i<n; ++i) if(arr1[i] != arr5[i] || arr1[i] != arr6[i]) printf("Error parallel merge sort\n");
+
+    printf("End of parallel merge sort\n");
     
     // Count Sort
     CountSort(arr4, n);
@@ -59,8 +267,218 @@ int main() {
     // compare to sorted array
     for(int i=0; i<n; ++i) if(arr1[i] != arr4[i]) printf("Error count sort\n");
 
+    // parallel count sort with sparse values, stable count sort of records by key
+    int count_n = 300000;
+    int* counted = new int[count_n];
+    int* counted_ref = new int[count_n];
+    Record* keyed = new Record[count_n];
+    for(int i=0; i<count_n; ++i) {
+        counted[i] = counted_ref[i] = (int)((long long)i*koef1 % koef2) * 16 - koef2;
+        keyed[i].key = (int)((long long)i*koef1 % koef2) % 100;
+        keyed[i].id = i;
+    }
+    ArrParallelCountSort(counted, count_n, 4);
+    ArrQuickSort<int>(counted_ref, count_n);
+    ArrCountSortBy<Record>(keyed, count_n, Member(&Record::key), (Record*)NULL, 4);
+    for(int i=0; i<count_n; ++i) {
+        if(counted[i] != counted_ref[i]) printf("Error count sort\n");
+        if(i > 0 && (keyed[i-1].key > keyed[i].key || (keyed[i-1].key == keyed[i].key && keyed[i-1].id > keyed[i].id))) printf("Error count sort\n");
+    }
+    delete[] counted;
+    delete[] counted_ref;
+    delete[] keyed;
+
     printf("End of count sort\n");
 
+    // Radix Sort
+    int* arr7 = new int[n];
+    uint64_t* arr8 = new uint64_t[n];
+    float* arr9 = new float[n];
+    double* arr10 = new double[n];
+    for(int i=0; i<n; ++i) {
+        arr7[i] = (i*koef1) % koef2 - koef2/2;
+        arr8[i] = ((uint64_t)((i*koef1) % koef2) << 40) + i;
+        arr9[i] = ((i*koef1) % koef2 - koef2/2) * 0.25f;
+        arr10[i] = ((i*koef1) % koef2 - koef2/2) * 1e100;
+    }
+
+    ArrRadixSort(arr7, n);
+    ArrRadixSort(arr8, n);
+    ArrRadixSort(arr9, n);
+    ArrRadixSort(arr10, n);
+
+    // compare to sorted array
+    for(int i=0; i<n; ++i) if(arr7[i] != arr1[i] - koef2/2) printf("Error radix sort\n");
+    for(int i=0; i<n-1; ++i) if(arr8[i] > arr8[i+1] || arr9[i] > arr9[i+1] || arr10[i] > arr10[i+1]) printf("Error radix sort\n");
+
+    printf("End of radix sort\n");
+
+    // Adaptive sort
+    ArrSortEngine::Info info;
+    int* arr11 = new int[n];
+    long long* arr12 = new long long[n];
+
+    for(int i=0; i<n; ++i) arr11[i] = arr1[n-1-i];
+    ArrSort<int>(arr11, n, &info);
+    if(info.engine != ArrSortEngine::REVERSE) printf("Error adaptive sort\n");
+    for(int i=0; i<n; ++i) if(arr11[i] != arr1[i]) printf("Error adaptive sort\n");
+
+    ArrSort<int>(arr11, n, &info);
+    if(info.engine != ArrSortEngine::NONE) printf("Error adaptive sort\n");
+
+    for(int i=0; i<n; ++i) arr11[i] = (i*koef1) % koef2 / 4;
+    ArrSort<int>(arr11, n, &info);
+    if(info.engine != ArrSortEngine::COUNT || info.range != arr1[n-1]/4 - arr1[0]/4) printf("Error adaptive sort\n");
+    for(int i=0; i<n; ++i) if(arr11[i] != arr1[i] / 4) printf("Error adaptive sort\n");
+
+    for(int i=0; i<n; ++i) arr11[i] = (i*koef1) % koef2 * 100000;
+    ArrSort<int>(arr11, n, &info);
+    if(info.engine != ArrSortEngine::RADIX) printf("Error adaptive sort\n");
+    for(int i=0; i<n; ++i) if(arr11[i] != arr1[i] * 100000) printf("Error adaptive sort\n");
+
+    for(int i=0; i<n; ++i) arr12[i] = (i*koef1) % koef2;
+    ArrSort<long long>(arr12, n, &info);
+    if(info.engine != ArrSortEngine::QUICK) printf("Error adaptive sort\n");
+    for(int i=0; i<n; ++i) if(arr12[i] != arr1[i]) printf("Error adaptive sort\n");
+
+    printf("End of adaptive sort\n");
+
+
+    // Selection and top-k
+    ///////////////////////
+
+    for(int i=0; i<n; ++i) arr3[i] = (i*koef1) % koef2;
+    ArrNthElement<int>(arr3, n, n/3);
+    if(arr3[n/3] != arr1[n/3]) printf("Error selection\n");
+    for(int i=0; i<n; ++i) if((i < n/3 && arr3[i] > arr3[n/3]) || (i > n/3 && arr3[i] < arr3[n/3])) printf("Error selection\n");
+
+    // heap selection for small k, introselect for large k
+    for(int k=5; k<=n/2; k*=10) {
+        for(int i=0; i<n; ++i) arr3[i] = (i*koef1) % koef2;
+        ArrPartialSort<int>(arr3, n, k);
+        for(int i=0; i<k; ++i) if(arr3[i] != arr1[i]) printf("Error selection\n");
+    }
+
+    // top-k of array and of a stream
+    int* top = new int[100];
+    if(ArrTopK<int>(arr4, n, 100, top) != 100) printf("Error selection\n");
+    for(int i=0; i<100; ++i) if(top[i] != arr1[n-1-i]) printf("Error selection\n");
+    TopK<int, Greater> lowest(100);
+    for(int i=0; i<n; ++i) lowest.Push((i*koef1) % koef2);
+    if(lowest.Length() != 100 || lowest.Threshold() != arr1[99] || lowest.Extract(top) != 100) printf("Error selection\n");
+    for(int i=0; i<100; ++i) if(top[i] != arr1[i]) printf("Error selection\n");
+    delete[] top;
+
+    printf("End of selection\n");
+
+
+    // Moving elements
+    ///////////////////
+
+    // sorts only move elements, moved-from ones compare larger than all others
+    Counted* moving = new Counted[n];
+    for(int algorithm=0; algorithm<9; ++algorithm) {
+        for(int i=0; i<n; ++i) moving[i] = Counted((i*koef1) % koef2 / 8);
+        Counted::copies = 0;
+        if(algorithm == 0) ArrQuickSort<Counted>(moving, n);
+        if(algorithm == 1) ArrMergeSort<Counted>(moving, n);
+        if(algorithm == 2) ArrMergeSortBottomUp<Counted>(moving, n);
+        if(algorithm == 3) ArrHeapSort<Counted>(moving, n);
+        if(algorithm == 4) ArrInsertionSort<Counted>(moving, n);
+        if(algorithm == 5) ArrSort<Counted>(moving, n);
+        if(algorithm == 6) ArrParallelMergeSort<Counted>(moving, n, 4, 100);
+        if(algorithm == 7) ArrPartialSort<Counted>(moving, n, n/2);
+        if(algorithm == 8) ArrCountSortBy<Counted>(moving, n, Member(&Counted::key), (Counted*)NULL, 4);
+        if(Counted::copies != 0) printf("Error moving sort %d\n", algorithm);
+        for(int i=0; i<(algorithm == 7? n/2: n); ++i) if(moving[i].key != arr1[i] / 8) printf("Error moving sort %d\n", algorithm);
+    }
+    delete[] moving;
+
+    // streaming top-k keeps moved elements
+    Counted::copies = 0;
+    TopK<Counted> moving_top(100);
+    for(int i=0; i<n; ++i) moving_top.Push(Counted((i*koef1) % koef2));
+    if(Counted::copies != 0 || moving_top.Threshold().key != arr1[n-100]) printf("Error moving top-k\n");
+
+    printf("End of moving elements\n");
+
+
+    // Custom ordering
+    ///////////////////
+
+    Record* recs = new Record[n];
+    Record* recs2 = new Record[n];
+    int* perm = new int[n];
+    for(int i=0; i<n; ++i) {
+        recs[i].key = (i*koef1) % koef2 / 8;
+        recs[i].id = i;
+        recs2[i] = recs[i];
+    }
+
+    // stable sort by member, equal keys keep order of ids
+    ArrMergeSort<Record>(recs, n, NULL, Less(), Member(&Record::key));
+    for(int i=0; i<n; ++i) if(recs[i].key != arr1[i] / 8) printf("Error custom ordering\n");
+    for(int i=0; i<n-1; ++i) if(recs[i].key == recs[i+1].key && recs[i].id > recs[i+1].id) printf("Error custom ordering\n");
+    if(!BinarySearch<Record>(recs, arr1[n/2] / 8, 0, n-1, Less(), Member(&Record::key))) printf("Error custom ordering\n");
+    if(BinarySearch<Record>(recs, -1, 0, n-1, Less(), Member(&Record::key))) printf("Error custom ordering\n");
+
+    // arg sort gives the same order without moving the records
+    ArrArgSort<Record>(recs2, n, perm, Less(), Member(&Record::key));
+    for(int i=0; i<n; ++i) if(recs2[perm[i]].id != recs[i].id || recs2[i].id != i) printf("Error custom ordering\n");
+    ptrdiff_t* wide_perm = new ptrdiff_t[n];
+    ArrArgSort<Record>(recs2, n, wide_perm, Less(), Member(&Record::key));
+    for(int i=0; i<n; ++i) if(wide_perm[i] != perm[i]) printf("Error custom ordering\n");
+    delete[] wide_perm;
+
+    // descending order by other sorts
+    for(int i=0; i<n; ++i) arr3[i] = (i*koef1) % koef2;
+    ArrQuickSort<int>(arr3, n, Greater());
+    for(int i=0; i<n; ++i) if(arr3[i] != arr1[n-1-i]) printf("Error custom ordering\n");
+    ArrSort<int>(arr3, n, &info, Less());
+    for(int i=0; i<n; ++i) if(arr3[i] != arr1[i]) printf("Error custom ordering\n");
+    ArrParallelMergeSort<int>(arr3, n, 4, 64, Greater());
+    for(int i=0; i<n; ++i) if(arr3[i] != arr1[n-1-i]) printf("Error custom ordering\n");
+    ArrSort<Record>(recs2, n, &info, Greater(), Member(&Record::key));
+    if(info.engine != ArrSortEngine::QUICK) printf("Error custom ordering\n");
+    for(int i=0; i<n; ++i) if(recs2[i].key != arr1[n-1-i] / 8) printf("Error custom ordering\n");
+
+    delete[] recs;
+    delete[] perm;
+
+    printf("End of custom ordering\n");
+
+
+    // External merge sort
+    ///////////////////////
+
+    // small memory budget forces many runs and several merge passes
+    FILE* ext_file = fopen("algo_test_sort.bin", "wb");
+    for(int i=0; i<n; ++i) arr3[i] = (i*koef1) % koef2;
+    fwrite(arr3, sizeof(int), n, ext_file);
+    fclose(ext_file);
+    ExternalSort::Config ext_config;
+    ext_config.memory = 256;
+    ext_config.max_ways = 3;
+    if(!ExternalMergeSort<int>("algo_test_sort.bin", "algo_test_sort.bin", ext_config)) printf("Error external sort\n");
+    ext_file = fopen("algo_test_sort.bin", "rb");
+    if(fread(arr3, sizeof(int), n, ext_file) != (size_t)n || fgetc(ext_file) != EOF) printf("Error external sort\n");
+    fclose(ext_file);
+    for(int i=0; i<n; ++i) if(arr1[i] != arr3[i]) printf("Error external sort\n");
+
+    // records sorted by member in one run
+    ext_file = fopen("algo_test_sort.bin", "wb");
+    fwrite(recs2, sizeof(Record), n, ext_file);
+    fclose(ext_file);
+    if(!ExternalMergeSort<Record>("algo_test_sort.bin", "algo_test_sort.bin", ExternalSort::Config(), Less(), Member(&Record::key))) printf("Error external sort\n");
+    ext_file = fopen("algo_test_sort.bin", "rb");
+    if(fread(recs2, sizeof(Record), n, ext_file) != (size_t)n) printf("Error external sort\n");
+    fclose(ext_file);
+    for(int i=0; i<n; ++i) if(recs2[i].key != arr1[i] / 8) printf("Error external sort\n");
+    remove("algo_test_sort.bin");
+    delete[] recs2;
+
+    printf("End of external sort\n");
+
     
     // Binary Search 
     /////////////////
@@ -72,9 +490,124 @@ int main() {
     if(BinarySearch<int>(arr1, -1, 0, n-1)) printf("Error binary search\n");
     if(BinarySearch<int>(arr1,  koef2 + 1, 0, n-1)) printf("Error binary search\n");
 
+    // bounds and equal range, arr11 has runs of equal elements
+    for(int i=0; i<n; ++i) arr11[i] = arr1[i] / 16;
+    ptrdiff_t range_beg, range_end;
+    for(int v=-1; v<=arr11[n-1]+1; ++v) {
+        int lower = 0;
+        while(lower < n && arr11[lower] < v) ++lower;
+        int upper = lower;
+        while(upper < n && arr11[upper] == v) ++upper;
+        EqualRange<int>(arr11, n, v, &range_beg, &range_end);
+        if(LowerBound<int>(arr11, n, v) != lower || UpperBound<int>(arr11, n, v) != upper) printf("Error binary search\n");
+        if(range_beg != lower || range_end != upper) printf("Error binary search\n");
+    }
+
+    // batched search of unsorted and sorted queries
+    int* queries = new int[n];
+    int* positions = new int[n];
+    for(int i=0; i<n; ++i) queries[i] = (i*koef1) % koef2 / 16 - 1;
+    BinarySearchBatch<int>(arr11, n, queries, n, positions);
+    for(int i=0; i<n; ++i) if(positions[i] != LowerBound<int>(arr11, n, queries[i])) printf("Error binary search\n");
+    ArrSort<int>(queries, n);
+    BinarySearchBatch<int>(arr11, n, queries, n, positions);
+    for(int i=0; i<n; ++i) if(positions[i] != LowerBound<int>(arr11, n, queries[i])) printf("Error binary search\n");
+    delete[] queries;
+    delete[] positions;
+
+    // Eytzinger layout index
+    EytzingerIndex<int> eytzinger(arr11, n);
+    for(int v=-1; v<=arr11[n-1]+1; ++v) {
+        int lower = LowerBound<int>(arr11, n, v);
+        if(eytzinger.LowerBound(v) != lower) printf("Error binary search\n");
+        if(eytzinger.Contains(v) != (lower < n && arr11[lower] == v)) printf("Error binary search\n");
+    }
+
+    // Eytzinger index of 32 byte records and of strings, whose arrays are not aligned to their size
+    WideRecord* wide = new WideRecord[1000];
+    std::string* strings = new std::string[1000];
+    for(int i=0; i<1000; ++i) {
+        wide[i].key = 2*i;
+        strings[i] = std::string(1, (char)('a' + i / 100)) + (char)('a' + i / 10 % 10) + (char)('a' + i % 10);
+    }
+    EytzingerIndex<WideRecord, Less, MemberProjection<WideRecord, int64_t> > wide_index(wide, 1000, Less(), Member(&WideRecord::key));
+    EytzingerIndex<std::string> string_index(strings, 1000);
+    EytzingerIndex<std::string> empty_index(strings, 0);
+    for(int i=0; i<1000; ++i) {
+        if(wide_index.LowerBound(2*i - 1) != i || !wide_index.Contains(2*i) || wide_index.Contains(2*i + 1)) printf("Error binary search\n");
+        if(string_index.LowerBound(strings[i]) != i || !string_index.Contains(strings[i])) printf("Error binary search\n");
+    }
+    if(wide_index.LowerBound(2000) != 1000 || string_index.Contains(std::string("zzz")) || empty_index.LowerBound(strings[0]) != 0) printf("Error binary search\n");
+    delete[] wide;
+    delete[] strings;
+
+    // interpolation search and learned index
+    LearnedIndex<int> learned(arr11, n, 4);
+    for(int v=-1; v<=arr11[n-1]+1; ++v) {
+        int lower = LowerBound<int>(arr11, n, v);
+        if(InterpolationSearch<int>(arr11, n, v) != lower) printf("Error binary search\n");
+        if(learned.LowerBound(v) != lower) printf("Error binary search\n");
+        if(learned.Contains(v) != (lower < n && arr11[lower] == v)) printf("Error binary search\n");
+    }
+
     printf("End of binary search\n");
 
 
+    // Set operations on sorted arrays
+    ///////////////////////////////////
+
+    // a has multiples of 2, b multiples of 3, c multiples of 97
+    int* set_a = new int[1000];
+    int* set_b = new int[1000];
+    int* set_c = new int[21];
+    int* set_out = new int[2000];
+    for(int i=0; i<1000; ++i) {
+        set_a[i] = 2*i;
+        set_b[i] = 3*i;
+    }
+    for(int i=0; i<21; ++i) set_c[i] = 97*i;
+
+    ptrdiff_t set_len = ArrIntersect<int>(set_a, 1000, set_b, 1000, set_out);
+    if(set_len != 334 || ArrIntersectCount<int>(set_a, 1000, set_b, 1000) != 334) printf("Error set operations\n");
+    for(ptrdiff_t i=0; i<set_len; ++i) if(set_out[i] % 6 != 0 || (i > 0 && set_out[i-1] >= set_out[i])) printf("Error set operations\n");
+    set_len = ArrUnion<int>(set_a, 1000, set_b, 1000, set_out);
+    if(set_len != 1666) printf("Error set operations\n");
+    for(ptrdiff_t i=0; i<set_len; ++i) if((set_out[i] % 2 != 0 && set_out[i] % 3 != 0) || (i > 0 && set_out[i-1] >= set_out[i])) printf("Error set operations\n");
+    set_len = ArrDifference<int>(set_a, 1000, set_b, 1000, set_out);
+    if(set_len != 666) printf("Error set operations\n");
+    for(ptrdiff_t i=0; i<set_len; ++i) if(set_out[i] % 2 != 0 || set_out[i] % 3 == 0 || (i > 0 && set_out[i-1] >= set_out[i])) printf("Error set operations\n");
+
+    // skewed lengths are galloped through
+    if(ArrIntersect<int>(set_c, 21, set_a, 1000, set_out) != 11 || ArrIntersectCount<int>(set_a, 1000, set_c, 21) != 11) printf("Error set operations\n");
+    for(int i=0; i<11; ++i) if(set_out[i] != 194*i) printf("Error set operations\n");
+    if(ArrUnion<int>(set_a, 1000, set_c, 21, set_out) != 1010) printf("Error set operations\n");
+    if(ArrDifference<int>(set_a, 1000, set_c, 21, set_out) != 989) printf("Error set operations\n");
+    if(ArrDifference<int>(set_c, 21, set_a, 1000, set_out) != 10) printf("Error set operations\n");
+    for(int i=0; i<10; ++i) if(set_out[i] != 97 + 194*i) printf("Error set operations\n");
+
+    // generic path gives the same results
+    double* set_da = new double[1000];
+    double* set_db = new double[1000];
+    double* set_dout = new double[2000];
+    for(int i=0; i<1000; ++i) {
+        set_da[i] = set_a[i];
+        set_db[i] = set_b[i];
+    }
+    if(ArrIntersect<double>(set_da, 1000, set_db, 1000, set_dout) != 334) printf("Error set operations\n");
+    if(ArrUnion<double>(set_da, 1000, set_db, 1000, set_dout) != 1666) printf("Error set operations\n");
+    if(ArrDifference<double>(set_da, 1000, set_db, 1000, set_dout) != 666) printf("Error set operations\n");
+    if(ArrIntersect<int>(set_a, 0, set_b, 1000, set_out) != 0 || ArrUnion<int>(set_a, 0, set_b, 1000, set_out) != 1000) printf("Error set operations\n");
+    delete[] set_a;
+    delete[] set_b;
+    delete[] set_c;
+    delete[] set_out;
+    delete[] set_da;
+    delete[] set_db;
+    delete[] set_dout;
+
+    printf("End of set operations\n");
+
+
     ///////////////////////
     //// F/LIFO TEST
     ///////////////////////
@@ -91,11 +624,215 @@ int main() {
         if(fifo.Remove() != lifo.Remove()) printf("Error l/fifo\n");
     }
 
+    // ring buffer wraps around and keeps the order when it grows
+    FIFO<int> fifo2(100);
+    if(fifo2.Capacity() != 128 || !fifo2.IsEmpty()) printf("Error l/fifo\n");
+    int fifo_in = 0, fifo_out = 0;
+    for(int round=0; round<50; ++round) {
+        for(int i=0; i<round*7; ++i) fifo2.Insert(fifo_in++);
+        for(int i=0; i<round*5; ++i) if(fifo2.Remove() != fifo_out++) printf("Error l/fifo\n");
+    }
+    if(fifo2.Length() != fifo_in - fifo_out) printf("Error l/fifo\n");
+    while(!fifo2.IsEmpty()) if(fifo2.Remove() != fifo_out++) printf("Error l/fifo\n");
+    if(fifo_out != fifo_in) printf("Error l/fifo\n");
+    fifo2.ShrinkToFit();
+    if(fifo2.Capacity() != FIFO<int>::MIN_CAPACITY) printf("Error l/fifo\n");
+
+    LIFO<int> lifo2;
+    for(int i=0; i<n; ++i) lifo2.Insert(i);
+    if(lifo2.Length() != n || lifo2.IsEmpty()) printf("Error l/fifo\n");
+    for(int i=n-1; i>=0; --i) if(lifo2.Remove() != i) printf("Error l/fifo\n");
+    if(!lifo2.IsEmpty()) printf("Error l/fifo\n");
+    lifo2.ShrinkToFit();
+    if(lifo2.Capacity() != LIFO<int>::MIN_CAPACITY) printf("Error l/fifo\n");
+
+    // only the elements in the buffers are constructed, removed ones are destroyed
+    {
+        FIFO<Alive> alive_fifo(1000);
+        LIFO<Alive> alive_lifo(1000);
+        if(Alive::count != 0) printf("Error l/fifo\n");
+        for(int round=0; round<20; ++round) {
+            for(int i=0; i<round*7; ++i) {
+                alive_fifo.Insert(Alive(i));
+                alive_lifo.Insert(Alive(i));
+            }
+            for(int i=0; i<round*5; ++i) {
+                alive_fifo.Remove();
+                alive_lifo.Remove();
+            }
+        }
+        if(Alive::count != alive_fifo.Length() + alive_lifo.Length()) printf("Error l/fifo\n");
+        alive_fifo.ShrinkToFit();
+        alive_lifo.ShrinkToFit();
+        if(Alive::count != alive_fifo.Length() + alive_lifo.Length()) printf("Error l/fifo\n");
+    }
+    if(Alive::count != 0) printf("Error l/fifo\n");
+
+    // list with pooled nodes reuses the removed ones
+    SinglyLL<int, PoolAllocator> pool_list;
+    for(int round=0; round<3; ++round) {
+        for(int i=0; i<n; ++i) pool_list.Append(i);
+        for(int i=0; i<n; ++i) if(pool_list.RemoveFirst() != i) printf("Error l/fifo allocator\n");
+    }
+    for(int i=0; i<n; ++i) pool_list.Insert(i);
+
+    // elements are moved in and out or constructed in place, none of them is copied
+    Counted::copies = 0;
+    SinglyLL<Counted> moving_list;
+    DoublyLL<Counted> moving_dlist;
+    FIFO<Counted> moving_fifo;
+    LIFO<Counted> moving_lifo;
+    for(int i=0; i<n; ++i) {
+        moving_list.EmplaceAppend(i);
+        moving_dlist.Append(Counted(i));
+        moving_fifo.Emplace(i);
+        moving_lifo.Insert(Counted(i));
+    }
+    for(int i=0; i<n; ++i) {
+        if(moving_list.RemoveFirst().key != i || moving_fifo.Remove().key != i) printf("Error moving l/fifo\n");
+        if(moving_lifo.Remove().key != n-1-i) printf("Error moving l/fifo\n");
+    }
+    for(int i=0; i<n/2; ++i) {
+        if(moving_dlist.RemoveFirst().key != i || moving_dlist.RemoveLast().key != n-1-i) printf("Error moving l/fifo\n");
+    }
+    if(Counted::copies != 0 || !moving_list.IsEmpty() || !moving_dlist.IsEmpty()) printf("Error moving l/fifo\n");
+
+    // emplaced elements are constructed in their slots, neither copied nor moved
+    moving_fifo.Reserve(n);
+    moving_lifo.Reserve(n);
+    Counted::moves = 0;
+    for(int i=0; i<n; ++i) {
+        moving_fifo.Emplace(i);
+        moving_lifo.Emplace(i);
+    }
+    if(Counted::copies != 0 || Counted::moves != 0 || moving_fifo.Length() != n || moving_lifo.Length() != n) printf("Error moving l/fifo\n");
+
+    // doubly linked list is empty after its last element is removed from either end
+    moving_dlist.EmplaceInsert(1);
+    moving_dlist.EmplaceInsert(0);
+    moving_dlist.EmplaceAppend(2);
+    for(int i=2; i>=0; --i) if(moving_dlist.RemoveLast().key != i) printf("Error doubly linked list\n");
+    moving_dlist.EmplaceAppend(3);
+    if(moving_dlist.RemoveFirst().key != 3 || !moving_dlist.IsEmpty()) printf("Error doubly linked list\n");
+    moving_dlist.EmplaceInsert(4);
+    if(moving_dlist.Length() != 1 || moving_dlist.RemoveLast().key != 4) printf("Error doubly linked list\n");
+
 
 
     printf("End of binary l/fifo\n");
 
 
+    ///////////////////////
+    //// CONCURRENT QUEUES TEST
+    ///////////////////////
+
+    // SPSC queue refuses elements when full
+    SPSCQueue<int> spsc(60);
+    int spsc_value;
+    if(spsc.Capacity() != 64 || !spsc.IsEmpty() || spsc.TryRemove(&spsc_value)) printf("Error SPSC queue\n");
+    for(int i=0; i<64; ++i) if(!spsc.TryInsert(i)) printf("Error SPSC queue\n");
+    if(spsc.TryInsert(64) || spsc.TryInsertBatch(arr1, 10) != 0) printf("Error SPSC queue\n");
+    int spsc_batch[13];
+    if(spsc.TryRemoveBatch(spsc_batch, 13) != 13 || spsc_batch[12] != 12) printf("Error SPSC queue\n");
+    if(spsc.TryInsertBatch(arr1, 20) != 13) printf("Error SPSC queue\n");
+    for(int i=13; i<64; ++i) if(spsc.Remove() != i) printf("Error SPSC queue\n");
+    for(int i=0; i<13; ++i) if(spsc.Remove() != arr1[i]) printf("Error SPSC queue\n");
+    if(!spsc.IsEmpty()) printf("Error SPSC queue\n");
+
+    // elements from the producer thread arrive in order
+    int spsc_count = 100000;
+    std::thread spsc_producer(QueueProducer<SPSCQueue<int> >, &spsc, 0, spsc_count);
+    int spsc_next = 0;
+    while(spsc_next < spsc_count / 3) if(spsc.Remove() != spsc_next++) printf("Error SPSC queue\n");
+    while(spsc_next < spsc_count) {
+        ptrdiff_t got = spsc.TryRemoveBatch(spsc_batch, 13);
+        for(ptrdiff_t i=0; i<got; ++i) if(spsc_batch[i] != spsc_next++) printf("Error SPSC queue\n");
+        if(got == 0) std::this_thread::yield();
+    }
+    spsc_producer.join();
+    if(!spsc.IsEmpty()) printf("Error SPSC queue\n");
+
+    // MPMC queue refuses elements when full
+    MPMCQueue<int> mpmc(8);
+    int mpmc_value;
+    if(mpmc.Capacity() != 8 || !mpmc.IsEmpty() || mpmc.TryRemove(&mpmc_value)) printf("Error MPMC queue\n");
+    for(int round=0; round<3; ++round) {
+        for(int i=0; i<8; ++i) if(!mpmc.TryInsert(i)) printf("Error MPMC queue\n");
+        if(mpmc.TryInsert(8)) printf("Error MPMC queue\n");
+        for(int i=0; i<8; ++i) if(mpmc.Remove() != i) printf("Error MPMC queue\n");
+    }
+
+    // stress test, 4 producers and 4 consumers, every element is removed once and those of one producer in order
+    const int STRESS_THREADS = 4;
+    const int STRESS_COUNT = 50000;
+    int* stress_out = new int[STRESS_THREADS * STRESS_COUNT];
+    std::thread stress_threads[2 * STRESS_THREADS];
+    for(int t=0; t<STRESS_THREADS; ++t) {
+        stress_threads[t] = std::thread(ConcurrentProducer<MPMCQueue<int> >, &mpmc, t * STRESS_COUNT, STRESS_COUNT);
+        stress_threads[STRESS_THREADS + t] = std::thread(ConcurrentConsumer<MPMCQueue<int> >, &mpmc, STRESS_COUNT, stress_out + t * STRESS_COUNT);
+    }
+    for(int t=0; t<2*STRESS_THREADS; ++t) stress_threads[t].join();
+    for(int t=0; t<STRESS_THREADS; ++t) {
+        int last[STRESS_THREADS] = {-1, -1, -1, -1};
+        for(int i=0; i<STRESS_COUNT; ++i) {
+            int value = stress_out[t * STRESS_COUNT + i];
+            if(value <= last[value / STRESS_COUNT]) printf("Error MPMC queue\n");
+            last[value / STRESS_COUNT] = value;
+        }
+    }
+    ArrSort<int>(stress_out, STRESS_THREADS * STRESS_COUNT);
+    for(int i=0; i<STRESS_THREADS * STRESS_COUNT; ++i) if(stress_out[i] != i) printf("Error MPMC queue\n");
+    if(!mpmc.IsEmpty()) printf("Error MPMC queue\n");
+
+    // concurrent LIFO, single-threaded order and stress test
+    ConcurrentLIFO<int> clifo;
+    if(!clifo.IsEmpty() || clifo.TryRemove(&mpmc_value)) printf("Error concurrent LIFO\n");
+    for(int i=0; i<n; ++i) clifo.Insert(i);
+    for(int i=n-1; i>=0; --i) if(clifo.Remove() != i) printf("Error concurrent LIFO\n");
+    for(int t=0; t<STRESS_THREADS; ++t) {
+        stress_threads[t] = std::thread(ConcurrentProducer<ConcurrentLIFO<int> >, &clifo, t * STRESS_COUNT, STRESS_COUNT);
+        stress_threads[STRESS_THREADS + t] = std::thread(ConcurrentConsumer<ConcurrentLIFO<int> >, &clifo, STRESS_COUNT, stress_out + t * STRESS_COUNT);
+    }
+    for(int t=0; t<2*STRESS_THREADS; ++t) stress_threads[t].join();
+    ArrSort<int>(stress_out, STRESS_THREADS * STRESS_COUNT);
+    for(int i=0; i<STRESS_THREADS * STRESS_COUNT; ++i) if(stress_out[i] != i) printf("Error concurrent LIFO\n");
+    if(!clifo.IsEmpty()) printf("Error concurrent LIFO\n");
+
+    // threads register new hazard records while the earlier ones remove nodes and scan the records
+    const int REGISTER_THREADS = 32;
+    const int REGISTER_COUNT = 2000;
+    int* register_out = new int[REGISTER_THREADS * REGISTER_COUNT];
+    std::thread register_threads[REGISTER_THREADS];
+    for(int t=0; t<REGISTER_THREADS; ++t) {
+        register_threads[t] = std::thread(ConcurrentInsertRemove<ConcurrentLIFO<int> >, &clifo, t * REGISTER_COUNT, REGISTER_COUNT,
+                                          register_out + t * REGISTER_COUNT);
+    }
+    for(int t=0; t<REGISTER_THREADS; ++t) register_threads[t].join();
+    ArrSort<int>(register_out, REGISTER_THREADS * REGISTER_COUNT);
+    for(int i=0; i<REGISTER_THREADS * REGISTER_COUNT; ++i) if(register_out[i] != i) printf("Error concurrent LIFO\n");
+    if(!clifo.IsEmpty()) printf("Error concurrent LIFO\n");
+    delete[] register_out;
+    delete[] stress_out;
+
+    // elements are moved through the concurrent structures
+    Counted::copies = 0;
+    SPSCQueue<Counted> moving_spsc(16);
+    MPMCQueue<Counted> moving_mpmc(16);
+    ConcurrentLIFO<Counted> moving_clifo;
+    for(int i=0; i<10; ++i) {
+        moving_spsc.Insert(Counted(i));
+        moving_mpmc.Insert(Counted(i));
+        moving_clifo.Emplace(i);
+    }
+    for(int i=0; i<10; ++i) {
+        if(moving_spsc.Remove().key != i || moving_mpmc.Remove().key != i) printf("Error moving concurrent queues\n");
+        if(moving_clifo.Remove().key != 9-i) printf("Error moving concurrent queues\n");
+    }
+    if(Counted::copies != 0) printf("Error moving concurrent queues\n");
+
+    printf("End of concurrent queues\n");
+
+
 
 
 
@@ -108,6 +845,7 @@ int main() {
     
     for(int i=0; i<1000; ++i) avltree.Insert(i);
     for(int i=0; i<1000; ++i) if(!avltree.Find(i)) printf("Error AVL tree\n");
+    if(avltree.GetStats().rotations == 0 || avltree.GetStats().height > 15) printf("Error AVL tree stats\n");
 
     for(int i=999; i>=0; --i) avltree.Remove(i);
     for(int i=0; i<1000; ++i) if(avltree.Find(i)) printf("Error AVL tree\n");
@@ -115,6 +853,43 @@ int main() {
     for(int i=500; i>-500; --i) avltree.Insert(i);
     for(int i=-1000; i<1000; ++i) if(avltree.Find(i) != (i <= 500 && i>-500)) printf("Error AVL Tree\n");
 
+    // insert and remove in scattered order
+    AVLTree<int> avltree2;
+    for(int i=0; i<1000; ++i) avltree2.Insert((i*koef1) % 1009);
+    for(int i=0; i<1000; i+=2) avltree2.Remove((i*koef1) % 1009);
+    for(int i=0; i<1000; ++i) if(avltree2.Find((i*koef1) % 1009) != (i % 2 == 1)) printf("Error AVL Tree\n");
+
+    // nodes from a pool and from an arena, both take only a few blocks from the system
+    ResetThreadStats();
+    AVLTree<int, PoolAllocator> avltree_pool;
+    AVLTree<int, ArenaAllocator> avltree_arena;
+    for(int i=0; i<1000; ++i) {
+        avltree_pool.Insert((i*koef1) % 1009);
+        avltree_arena.Insert((i*koef1) % 1009);
+    }
+    for(int i=0; i<1000; i+=2) {
+        avltree_pool.Remove((i*koef1) % 1009);
+        avltree_arena.Remove((i*koef1) % 1009);
+    }
+    for(int i=0; i<1000; ++i) {
+        if(avltree_pool.Find((i*koef1) % 1009) != (i % 2 == 1)) printf("Error AVL Tree allocator\n");
+        if(avltree_arena.Find((i*koef1) % 1009) != (i % 2 == 1)) printf("Error AVL Tree allocator\n");
+    }
+    for(int i=0; i<1000; ++i) avltree_pool.Insert((i*koef1) % 1009 + 2000);
+    if(GetThreadStats().allocations > 4) printf("Error AVL Tree allocator stats\n");
+    avltree_arena.Clear();
+    for(int i=0; i<1000; ++i) if(avltree_arena.Find(i)) printf("Error AVL Tree allocator\n");
+    for(int i=0; i<100; ++i) avltree_arena.Insert(i);
+    for(int i=0; i<100; ++i) if(!avltree_arena.Find(i)) printf("Error AVL Tree allocator\n");
+
+    // elements are moved into the tree, removing a node with two children moves its successor
+    Counted::copies = 0;
+    AVLTree<Counted> avltree_moving;
+    for(int i=0; i<1000; ++i) avltree_moving.Insert(Counted((i*koef1) % 1009));
+    for(int i=0; i<1000; i+=2) avltree_moving.Remove(Counted((i*koef1) % 1009));
+    for(int i=0; i<1000; ++i) if(avltree_moving.Find(Counted((i*koef1) % 1009)) != (i % 2 == 1)) printf("Error moving AVL Tree\n");
+    if(Counted::copies != 0) printf("Error moving AVL Tree\n");
+
     printf("End of AVL tree\n");
     
 
@@ -123,22 +898,54 @@ int main() {
     ///////////////////////
     
     // 2-4 tree
-    ABTree<int> abtree = ABTree<int>(2,4);
+    ABTree<int> abtree(2, 4);
    
 
     for(int i=0; i<1000; ++i) abtree.Insert(i);
     for(int i=0; i<1000; ++i) if(!abtree.Find(i)) printf("Error 2-4 tree\n");
+    if(abtree.GetStats().splits == 0 || abtree.GetStats().height < 5 || abtree.GetStats().height > 10) printf("Error 2-4 tree stats\n");
 
     for(int i=999; i>=0; --i) abtree.Remove(i);
     for(int i=0; i<1000; ++i) if(abtree.Find(i)) printf("Error 2-4 tree\n");
+    if(abtree.GetStats().joins == 0 || abtree.GetStats().height != 1) printf("Error 2-4 tree stats\n");
 
     for(int i=500; i>-500; --i) abtree.Insert(i);
     for(int i=-1000; i<1000; ++i) if(abtree.Find(i) != (i <= 500 && i>-500)) printf("Error 2-4 tree\n");
+
+    // insert and remove in scattered order
+    ABTree<int> abtree3(2, 4);
+    for(int i=0; i<1000; ++i) abtree3.Insert((i*koef1) % 1009);
+    for(int i=0; i<1000; i+=2) abtree3.Remove((i*koef1) % 1009);
+    for(int i=0; i<1000; ++i) if(abtree3.Find((i*koef1) % 1009) != (i % 2 == 1)) printf("Error 2-4 tree\n");
+
+    // nodes and knots from a pool and from an arena
+    ABTree<int, PoolAllocator> abtree_pool(2, 4);
+    ABTree<int, ArenaAllocator> abtree_arena(2, 4);
+    for(int i=0; i<1000; ++i) {
+        abtree_pool.Insert((i*koef1) % 1009);
+        abtree_arena.Insert((i*koef1) % 1009);
+    }
+    for(int i=0; i<1000; i+=2) {
+        abtree_pool.Remove((i*koef1) % 1009);
+        abtree_arena.Remove((i*koef1) % 1009);
+    }
+    for(int i=0; i<1000; ++i) {
+        if(abtree_pool.Find((i*koef1) % 1009) != (i % 2 == 1)) printf("Error 2-4 tree allocator\n");
+        if(abtree_arena.Find((i*koef1) % 1009) != (i % 2 == 1)) printf("Error 2-4 tree allocator\n");
+    }
+ 
+    // elements are moved into the knots, splits move keys between nodes
+    Counted::copies = 0;
+    ABTree<Counted> abtree_moving(2, 4);
+    for(int i=0; i<1000; ++i) abtree_moving.Insert(Counted((i*koef1) % 1009));
+    if(Counted::copies != 0) printf("Error moving 2-4 tree\n");
+    for(int i=0; i<1000; i+=2) abtree_moving.Remove(Counted((i*koef1) % 1009));
+    for(int i=0; i<1000; ++i) if(abtree_moving.Find(Counted((i*koef1) % 1009)) != (i % 2 == 1)) printf("Error moving 2-4 tree\n");
  
     printf("End of 2-4 tree\n");
     
     // 4-100 tree 
-    ABTree<int> abtree2 = ABTree<int>(4,100);
+    ABTree<int> abtree2(4, 100);
 
     for(int i=0; i<1000; ++i) abtree2.Insert(i);
     for(int i=0; i<1000; ++i) if(!abtree2.Find(i)) printf("Error č-100 tree\n");